@@ -14,9 +14,7 @@
 */
 
 #include <Wire.h>
-#include "arduinoFFT.h" // Standard Arduino FFT library 
-// https://github.com/kosme/arduinoFFT, in IDE, Sketch, Include Library, Manage Library, then search for FFT
-arduinoFFT FFT = arduinoFFT();
+#include <complex.h>
 /////////////////////////////////////////////////////////////////////////
 // Comment out the display your nNOT using e.g. if you have a 1.3" display comment out the SSD1306 library and object
 //#include "SH1106.h"     // https://github.com/squix78/esp8266-oled-ssd1306
@@ -24,15 +22,30 @@ arduinoFFT FFT = arduinoFFT();
 
 #include "SSD1306.h"  // https://github.com/squix78/esp8266-oled-ssd1306
 SSD1306 display(0x3c, 21, 22);  // 0.96" OLED display object definition (address, SDA, SCL) Connect OLED SDA , SCL pins to ESP SDA, SCL pins
+#include "oled_flush.h"         // the display is sent in the background
+oled_flush oled;
 /////////////////////////////////////////////////////////////////////////
 #define SAMPLES 512              // Must be a power of 2
 #define SAMPLING_FREQUENCY 40000 // Hz, must be 40000 or less due to ADC conversion time. Determines maximum frequency that can be analysed by the FFT Fmax=sampleF/2.
 #define amplitude 200            // Depending on your audio source level, you may need to increase this value
+#define DISPLAY_PERIOD 40ul      // ms, at most 25 pictures per second
+#define BANDS 7                  // bars on the display: 7, 16 or 32
+#define BAND_SCALE BANDS_OCTAVE  // spacing of the bands: BANDS_LOG, BANDS_OCTAVE or BANDS_MEL
+#define BAND_FMIN 100            // Hz, lowest frequency (log and mel)
+#define BAND_FMAX 16000          // Hz, highest frequency
+#define NOISE 2000               // A crude noise filter, 10 x amplitude or more
+#define MAGNITUDE_FAST false     // alpha max plus beta min instead of sqrt (less than 4% error)
+int LOG2SAMPLE = log(SAMPLES) / log(2);
+#include "fft.h"                 // single precision real FFT, as in the other sketches
+#include "bands.h"
+bands spectrum;
+char label[BANDS][8];            // frequency of each band, "0.5", "2K"...
 unsigned int sampling_period_us;
 unsigned long microseconds;
-byte peak[] = {0,0,0,0,0,0,0};
-double vReal[SAMPLES];
-double vImag[SAMPLES];
+byte peak[BANDS] = {0};
+float data[SAMPLES];             // the samples, then the bins, then their magnitudes
+float hamming[SAMPLES / 2];      // first half of the window, the other is symmetric
+const uint16_t *slot;            // slot of each sample in data: no bit-reversal pass
 unsigned long newTime, oldTime;
 /////////////////////////////////////////////////////////////////////////
 void setup() {
@@ -41,46 +54,54 @@ void setup() {
   display.init();
   display.setFont(ArialMT_Plain_10);
   display.flipScreenVertically(); // Adjust to suit or remove
+  oled_begin(&oled, 0x3c, display.width(), display.height(), DISPLAY_PERIOD);
+  if (!bands_init(&spectrum, BANDS, BAND_SCALE, BAND_FMIN, BAND_FMAX, SAMPLES, SAMPLING_FREQUENCY)) {
+    // No spectrum to show: stop with the error on the display
+    Serial.println("Not enough FFT bins for the bands");
+    display.clear();
+    display.drawString(0, 0, "Not enough FFT bins");
+    display.drawString(0, 12, "for the bands");
+    oled_show(&oled, display.buffer);
+    while (1) delay(1000);
+  }
+  for (int band = 0; band < BANDS; band++) {
+    int f = bands_freq(&spectrum, band);
+    if (f < 1000) snprintf(label[band], sizeof(label[band]), "0.%d", f / 100 % 10);
+    else snprintf(label[band], sizeof(label[band]), "%dK", (f + 500) / 1000 % 100);
+  }
+  rfft_init(LOG2SAMPLE);
+  slot = rfft_slots(LOG2SAMPLE);
+  for (int i = 0; i < SAMPLES / 2; i++) hamming[i] = 0.54 - 0.46 * cos(2 * PI * i / (SAMPLES - 1));
   sampling_period_us = round(1000000 * (1.0 / SAMPLING_FREQUENCY));
 }
 
 void loop() {
   display.clear();
-  display.drawString(0,0,"0.1 0.2 0.5 1K  2K  4K  8K");
+  const int pitch = display.width() / BANDS; // 18 pixels for 7 bands
+  const int step = (BANDS + 6) / 7;          // a label every step bands
+  for (int band = 0; band < BANDS; band += step) display.drawString(pitch * band, 0, label[band]);
   for (int i = 0; i < SAMPLES; i++) {
     newTime = micros()-oldTime;
     oldTime = newTime;
-    vReal[i] = analogRead(A0); // A conversion takes about 1uS on an ESP32
-    vImag[i] = 0;
+    float w = (i < SAMPLES / 2) ? hamming[i] : hamming[SAMPLES - 1 - i];
+    data[slot[i]] = analogRead(A0) * w; // A conversion takes about 1uS on an ESP32
     while (micros() < (newTime + sampling_period_us)) { /* do nothing to wait */ }
   }
-  FFT.Windowing(vReal, SAMPLES, FFT_WIN_TYP_HAMMING, FFT_FORWARD);
-  FFT.Compute(vReal, vImag, SAMPLES, FFT_FORWARD);
-  FFT.ComplexToMagnitude(vReal, vImag, SAMPLES);
-  for (int i = 2; i < (SAMPLES/2); i++){ // Don't use sample 0 and only first SAMPLES/2 are usable. Each array eleement represents a frequency and its value the amplitude.
-    if (vReal[i] > 2000) { // Add a crude noise filter, 10 x amplitude or more
-      if (i<=2 )             displayBand(0,(int)vReal[i]/amplitude); // 125Hz
-      if (i >3   && i<=5 )   displayBand(1,(int)vReal[i]/amplitude); // 250Hz
-      if (i >5   && i<=7 )   displayBand(2,(int)vReal[i]/amplitude); // 500Hz
-      if (i >7   && i<=15 )  displayBand(3,(int)vReal[i]/amplitude); // 1000Hz
-      if (i >15  && i<=30 )  displayBand(4,(int)vReal[i]/amplitude); // 2000Hz
-      if (i >30  && i<=53 )  displayBand(5,(int)vReal[i]/amplitude); // 4000Hz
-      if (i >53  && i<=200 ) displayBand(6,(int)vReal[i]/amplitude); // 8000Hz
-      if (i >200           ) displayBand(7,(int)vReal[i]/amplitude); // 16000Hz
-      //Serial.println(i);
-    }
-    for (byte band = 0; band <= 6; band++) display.drawHorizontalLine(18*band,64-peak[band],14);
+  rfft_evaluate_f(data, LOG2SAMPLE);
+  rfft_magnitude_f(data, LOG2SAMPLE, MAGNITUDE_FAST);
+  bands_reduce(&spectrum, data); // Each band as high as its loudest bin
+  for (int band = 0; band < BANDS; band++) {
+    if (spectrum.value[band] > NOISE) displayBand(band, pitch, (int)spectrum.value[band]/amplitude);
+    display.drawHorizontalLine(pitch*band, 64-peak[band], pitch*7/9);
   }
-  if (millis()%4 == 0) {for (byte band = 0; band <= 6; band++) {if (peak[band] > 0) peak[band] -= 1;}} // Decay the peak
-  display.display();
+  if (millis()%4 == 0) {for (byte band = 0; band < BANDS; band++) {if (peak[band] > 0) peak[band] -= 1;}} // Decay the peak
+  oled_present(&oled, display.buffer); // never waits for the I2C bus
 }
 
-void displayBand(int band, int dsize){
+void displayBand(int band, int pitch, int dsize){
   int dmax = 50;
   if (dsize > dmax) dsize = dmax;
-  if (band == 7) display.drawHorizontalLine(18*6,0, 14);
-  for (int s = 0; s <= dsize; s=s+2){display.drawHorizontalLine(18*band,64-s, 14);}
+  for (int s = 0; s <= dsize; s=s+2){display.drawHorizontalLine(pitch*band,64-s, pitch*7/9);}
   if (dsize > peak[band]) {peak[band] = dsize;}
 }
 
-
@@ -0,0 +1,121 @@
+/*
+   Frequency bands of the spectrum display
+
+   The FFT bins are gathered into n bands (7, 16 or 32 bars). The band
+   of each bin is computed once by bands_init, for any number of samples
+   and sampling frequency, and kept in a table: bands_reduce then goes
+   once over the magnitudes and keeps the max of each band (a bar as
+   high as its loudest bin).
+
+   Spacing of the band edges between fMin and fMax:
+     BANDS_LOG     evenly spaced on a log scale
+     BANDS_OCTAVE  octaves down from fMax, 1/2 octaves for 16 bands and
+                   more, 1/4 octaves for 32 (fMin is not used)
+     BANDS_MEL     evenly spaced on the mel scale
+   A band has at least one bin: at low frequencies, where the bands are
+   narrower than a bin, the edges are pushed up. Bins 0 and 1 (DC) are
+   never used.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define BANDS_LOG    0
+#define BANDS_OCTAVE 1
+#define BANDS_MEL    2
+#define BANDS_NONE   255            // bin in no band
+
+typedef struct
+{
+  int n;                            // number of bands
+  int bins;                         // bins in the table: samples / 2
+  uint8_t *band;                    // band of each bin, or BANDS_NONE
+  int *first;                       // first bin of each band
+  float binHz;                      // width of a bin
+  float *value;                     // max of the magnitudes of each band
+}
+bands;
+
+static float bands_mel(float f)
+{
+  return 2595.0 * log10(1.0 + f / 700.0);
+}
+
+static float bands_hz(float mel)
+{
+  return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+// Lower edge of band k (Hz), k = n is the upper edge of the last band
+static float bands_edge(int k, int n, int scale, float fMin, float fMax)
+{
+  switch (scale) {
+    case BANDS_OCTAVE: {
+        const int perOctave = (n >= 32) ? 4 : (n >= 16) ? 2 : 1;
+        return fMax * pow(2.0, (float) (k - n) / perOctave);
+      }
+    case BANDS_MEL:
+      return bands_hz(bands_mel(fMin) + (bands_mel(fMax) - bands_mel(fMin)) * k / n);
+    default:
+      return fMin * pow(fMax / fMin, (float) k / n);
+  }
+}
+
+void bands_free(bands *b)
+{
+  free(b->band);
+  free(b->first);
+  free(b->value);
+  b->band = NULL;
+  b->first = NULL;
+  b->value = NULL;
+  b->n = 0;
+  b->bins = 0;
+}
+
+// Builds the table of n bands for an FFT of samples at samplingHz,
+// false if the memory is missing or if there are less bins than bands:
+// then there are no bands (n = 0) and bands_reduce does nothing
+bool bands_init(bands *b, int n, int scale, float fMin, float fMax, int samples, float samplingHz)
+{
+  b->n = n;
+  b->bins = samples / 2;
+  b->binHz = samplingHz / samples;
+  b->band = (uint8_t *) malloc(b->bins);
+  b->first = (int *) malloc((n + 1) * sizeof(int));
+  b->value = (float *) calloc(n, sizeof(float));
+  if (b->band == NULL || b->first == NULL || b->value == NULL || n >= BANDS_NONE) {
+    bands_free(b);
+    return false;
+  }
+  for (int k = 0; k <= n; k++) {
+    int bin = ceil(bands_edge(k, n, scale, fMin, fMax) / b->binHz);
+    if (k == 0 && bin < 2) bin = 2;
+    if (k > 0 && bin <= b->first[k - 1]) bin = b->first[k - 1] + 1;
+    b->first[k] = bin;
+  }
+  if (b->first[n] > b->bins) {
+    bands_free(b);
+    return false;
+  }
+  for (int i = 0; i < b->bins; i++) b->band[i] = BANDS_NONE;
+  for (int k = 0; k < n; k++)
+    for (int i = b->first[k]; i < b->first[k + 1]; i++) b->band[i] = k;
+  return true;
+}
+
+// Max of the magnitudes (samples / 2 bins) in each band, into b->value
+void bands_reduce(bands *b, const float *magnitude)
+{
+  for (int k = 0; k < b->n; k++) b->value[k] = 0;
+  for (int i = 0; i < b->bins; i++) {
+    const uint8_t k = b->band[i];
+    if (k != BANDS_NONE && magnitude[i] > b->value[k]) b->value[k] = magnitude[i];
+  }
+}
+
+// Frequency of the first bin of band k (Hz), for the labels
+float bands_freq(const bands *b, int k)
+{
+  return b->first[k] * b->binHz;
+}
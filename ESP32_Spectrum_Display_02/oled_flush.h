@@ -0,0 +1,198 @@
+/*
+   Background flush of the SSD1306 display
+
+   display.display() sends the whole 1 KB buffer over I2C and waits for
+   the end (about 25 ms at 400 kHz) in the middle of the audio loop.
+   Here the sketch draws into the display buffer as before and hands
+   the picture over with oled_present: a copy into a buffer of the
+   service, a few microseconds. A background task (core 0, std::thread
+   on the host) sends the pictures, at most one per period.
+
+   Three buffers: the one the sketch copies into, the one being sent,
+   and the latest picture in between, swapped with the others by an
+   atomic exchange. The sketch never waits: a picture presented before
+   the previous one was sent replaces it (counted in replaced), and the
+   latest one is always sent.
+
+   Once the service is started, it owns the bus: display.display() must
+   not be called any more, oled_show replaces it for the screens which
+   must be seen before going on (it waits until the picture is sent).
+   On the host the bus is simulated: the task sleeps for the time of
+   the bytes at OLED_BUS_HZ.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#endif
+
+#define OLED_FRESH 4        // flag of the middle buffer: not sent yet
+#ifndef OLED_BUS_HZ
+#define OLED_BUS_HZ 400000  // I2C clock of the simulated bus (host)
+#endif
+
+typedef struct
+{
+  uint8_t address;              // I2C address of the display
+  int width, height;
+  size_t size;                  // bytes of a picture: width * height / 8
+  unsigned long periodMs;       // minimum time between two pictures
+  uint8_t *buf[3];
+  int write;                    // buffer of the sketch
+  int read;                     // buffer of the task
+  std::atomic<int> middle;      // latest picture, | OLED_FRESH if not sent
+  std::atomic<bool> busy;       // the task is sending
+  std::atomic<bool> running;
+  std::atomic<bool> done;
+  // Statistics
+  unsigned long presented;      // pictures presented
+  unsigned long replaced;       // presented before the previous one was sent
+  volatile unsigned long sent;  // pictures sent
+  volatile unsigned long maxSendUs;
+#ifndef ARDUINO
+  std::thread *task;
+#endif
+}
+oled_flush;
+
+static inline unsigned long oled_micros()
+{
+#ifdef ARDUINO
+  return micros();
+#else
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+static inline void oled_idle()
+{
+#ifdef ARDUINO
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+// An I2C transmission: a control byte (0x80 command, 0x40 data), then n bytes
+static void oled_write(uint8_t address, uint8_t control, const uint8_t *data, size_t n)
+{
+#ifdef ARDUINO
+  Wire.beginTransmission(address);
+  Wire.write(control);
+  Wire.write(data, n);
+  Wire.endTransmission();
+#else
+  // Address, control and data bytes, 9 clocks each (with the ack)
+  (void) address;
+  (void) control;
+  (void) data;
+  std::this_thread::sleep_for(std::chrono::microseconds((n + 2) * 9 * 1000000ull / OLED_BUS_HZ));
+#endif
+}
+
+// Sends a picture (horizontal addressing mode, set by display.init())
+void oled_send(const oled_flush *f, const uint8_t *picture)
+{
+  const uint8_t window[6] = {0x21, 0, (uint8_t) (f->width - 1),          // COLUMNADDR
+                             0x22, 0, (uint8_t) (f->height / 8 - 1)      // PAGEADDR
+                            };
+  for (int i = 0; i < 6; i++) oled_write(f->address, 0x80, window + i, 1);
+  for (size_t i = 0; i < f->size; i += 16) oled_write(f->address, 0x40, picture + i, 16);
+}
+
+// Sends the latest picture, at most one per period
+static void oled_run(oled_flush *f)
+{
+  unsigned long last = 0;
+  bool first = true;
+  while (f->running) {
+    if (!(f->middle & OLED_FRESH) || (!first && (oled_micros() - last) / 1000 < f->periodMs)) {
+      oled_idle();
+      continue;
+    }
+    f->busy = true;
+    f->read = f->middle.exchange(f->read) & 3;
+    last = oled_micros();
+    first = false;
+    oled_send(f, f->buf[f->read]);
+    unsigned long us = oled_micros() - last;
+    if (us > f->maxSendUs) f->maxSendUs = us;
+    ++f->sent;
+    f->busy = false;
+  }
+  f->done = true;
+}
+
+#ifdef ARDUINO
+static void oled_task(void *param)
+{
+  oled_run((oled_flush *) param);
+  vTaskDelete(NULL);
+}
+#endif
+
+// Starts the service for a width x height display at address, after
+// display.init()
+bool oled_begin(oled_flush *f, uint8_t address, int width, int height, unsigned long periodMs)
+{
+  f->address = address;
+  f->width = width;
+  f->height = height;
+  f->size = width * height / 8;
+  f->periodMs = periodMs;
+  for (int i = 0; i < 3; i++) {
+    f->buf[i] = (uint8_t *) calloc(f->size, 1);
+    if (f->buf[i] == NULL) return false;
+  }
+  f->write = 0;
+  f->middle = 1;
+  f->read = 2;
+  f->busy = false;
+  f->presented = f->replaced = f->sent = f->maxSendUs = 0;
+  f->done = false;
+  f->running = true;
+#ifdef ARDUINO
+  // Core 0, the audio loop runs on core 1
+  if (xTaskCreatePinnedToCore(oled_task, "display", 4096, f, 1, NULL, 0) != pdPASS) {
+    f->running = false;
+    return false;
+  }
+#else
+  f->task = new std::thread(oled_run, f);
+#endif
+  return true;
+}
+
+// Hands a picture (the display buffer) over to the task, without waiting
+void oled_present(oled_flush *f, const uint8_t *picture)
+{
+  memcpy(f->buf[f->write], picture, f->size);
+  const int old = f->middle.exchange(f->write | OLED_FRESH);
+  f->write = old & 3;
+  ++f->presented;
+  if (old & OLED_FRESH) ++f->replaced;
+}
+
+// Presents a picture and waits until it is sent, instead of display.display()
+void oled_show(oled_flush *f, const uint8_t *picture)
+{
+  oled_present(f, picture);
+  while ((f->middle & OLED_FRESH) || f->busy) oled_idle();
+}
+
+// Sends the last picture and stops the task
+void oled_end(oled_flush *f)
+{
+  while ((f->middle & OLED_FRESH) || f->busy) oled_idle();
+  f->running = false;
+  while (!f->done) oled_idle();
+#ifndef ARDUINO
+  f->task->join();
+  delete f->task;
+#endif
+  for (int i = 0; i < 3; i++) free(f->buf[i]);
+}
@@ -0,0 +1,237 @@
+/*
+   Dense network: a stack of fully connected layers, in the style of Tinn
+
+   The layers are given by their sizes (inputs, hidden layers ...,
+   outputs) and one activation per layer, output layer included. Each
+   neuron has its own bias. The weights, biases, layer values and deltas
+   of the network live in one arena, allocated once by xtbuild: the
+   struct only holds pointers into it and can be copied like a Tinn.
+
+   The weights of layer l are stored neuron by neuron: the size[l]
+   weights of neuron i of layer l + 1 follow each other, then its bias is
+   in b[l][i].
+
+   Needs Tinn.h (activations, errors, file readers).
+*/
+#define DENSE_MAX_LAYERS 8  // weight layers, output layer included
+
+typedef struct
+{
+  // Weights, biases, values and deltas.
+  float* arena;
+  // Number of weight layers (hidden layers + 1).
+  int nlayers;
+  // Neurons of each layer, inputs first.
+  int size[DENSE_MAX_LAYERS + 1];
+  // Activation of each weight layer.
+  int act[DENSE_MAX_LAYERS];
+  // Weights and biases of each weight layer.
+  float* w[DENSE_MAX_LAYERS];
+  float* b[DENSE_MAX_LAYERS];
+  // Values of each layer, a[0] is a copy of the input.
+  float* a[DENSE_MAX_LAYERS + 1];
+  // Deltas of two consecutive layers.
+  float* d[2];
+  // Output layer.
+  float* o;
+  // Number of inputs.
+  int nips;
+  // Number of outputs.
+  int nops;
+  // Number of weights and biases.
+  int nw;
+}
+Dense;
+
+// Floats of the arena for a part of n floats, keeping 16 bytes alignment.
+static int dense_round(const int n)
+{
+  return (n + 3) & ~3;
+}
+
+// Performs forward propagation.
+static void fprop(const Dense& t, const float* const in)
+{
+  for (int j = 0; j < t.nips; j++) t.a[0][j] = in[j];
+  for (int l = 0; l < t.nlayers; l++)
+  {
+    const int nin = t.size[l];
+    const float* const x = t.a[l];
+    float* const y = t.a[l + 1];
+    for (int i = 0; i < t.size[l + 1]; i++)
+    {
+      const float* const w = t.w[l] + i * nin;
+      float sum = t.b[l][i];
+      for (int j = 0; j < nin; j++)
+        sum += w[j] * x[j];
+      y[i] = sum;
+    }
+    switch (t.act[l]) {
+      case SIGMOID:
+        for (int i = 0; i < t.size[l + 1]; i++) y[i] = actT<SIGMOID>(y[i]);
+        break;
+      case RELU:
+        for (int i = 0; i < t.size[l + 1]; i++) y[i] = actT<RELU>(y[i]);
+        break;
+    }
+  }
+}
+
+// Performs back propagation.
+static void bprop(const Dense& t, const float* const tg, float rate)
+{
+  // Output deltas.
+  const int L = t.nlayers;
+  float* d = t.d[0];
+  for (int i = 0; i < t.nops; i++)
+    d[i] = pderr(t.o[i], tg[i]) * pdact(t.o[i], t.act[L - 1]);
+  for (int l = L - 1; l >= 0; l--)
+  {
+    const int nin = t.size[l];
+    const float* const x = t.a[l];
+    float* const prev = t.d[(L - l) & 1];
+    // Deltas of the layer below, with the weights before the update.
+    if (l > 0)
+    {
+      for (int j = 0; j < nin; j++) prev[j] = 0.0f;
+      for (int i = 0; i < t.size[l + 1]; i++)
+      {
+        const float* const w = t.w[l] + i * nin;
+        for (int j = 0; j < nin; j++) prev[j] += w[j] * d[i];
+      }
+      for (int j = 0; j < nin; j++) prev[j] *= pdact(x[j], t.act[l - 1]);
+    }
+    // Correct weights and biases of the layer.
+    for (int i = 0; i < t.size[l + 1]; i++)
+    {
+      float* const w = t.w[l] + i * nin;
+      const float g = rate * d[i];
+      for (int j = 0; j < nin; j++) w[j] -= g * x[j];
+      t.b[l][i] -= g;
+    }
+    d = prev;
+  }
+}
+
+// Returns an output prediction given an input.
+float* xtpredict(const Dense& t, const float* const in)
+{
+  fprop(t, in);
+  return t.o;
+}
+
+// Trains a dense network with an input and target output with a learning rate. Returns target to output error.
+float xttrain(const Dense& t, const float* const in, const float* const tg, float rate)
+{
+  fprop(t, in);
+  bprop(t, tg, rate);
+  return toterr(tg, t.o, t.nops);
+}
+
+// Constructs a dense network of nlayers weight layers: sizes holds the
+// nlayers + 1 layer sizes (inputs first, outputs last), acts the
+// activation of each weight layer.
+Dense xtbuild(const int nlayers, const int* const sizes, const int* const acts)
+{
+  Dense t;
+  memset(&t, 0, sizeof(t));
+  if (nlayers < 1 || nlayers > DENSE_MAX_LAYERS) {
+    Serial.printf("Dense network: %d layers, 1 to %d supported\n", nlayers, DENSE_MAX_LAYERS);
+    while (1);
+  }
+  t.nlayers = nlayers;
+  int total = 0, widest = 0;
+  for (int l = 0; l <= nlayers; l++) {
+    t.size[l] = sizes[l];
+    total += dense_round(sizes[l]);
+    if (sizes[l] > widest) widest = sizes[l];
+  }
+  t.nw = 0;
+  for (int l = 0; l < nlayers; l++) {
+    t.act[l] = acts[l];
+    t.nw += sizes[l + 1] * (sizes[l] + 1);
+    total += dense_round(sizes[l + 1] * sizes[l]) + dense_round(sizes[l + 1]);
+  }
+  total += 2 * dense_round(widest);
+  t.arena = (float*) calloc(total, sizeof(float));
+  if (t.arena == NULL) {
+    Serial.printf("Dense network: %u bytes not available\n", (unsigned) (total * sizeof(float)));
+    while (1);
+  }
+  // Carve the arena: weights and biases layer by layer, then the values.
+  float* p = t.arena;
+  for (int l = 0; l < nlayers; l++) {
+    t.w[l] = p;
+    p += dense_round(sizes[l + 1] * sizes[l]);
+    t.b[l] = p;
+    p += dense_round(sizes[l + 1]);
+  }
+  for (int l = 0; l <= nlayers; l++) {
+    t.a[l] = p;
+    p += dense_round(sizes[l]);
+  }
+  t.d[0] = p;
+  t.d[1] = p + dense_round(widest);
+  t.o = t.a[nlayers];
+  t.nips = sizes[0];
+  t.nops = sizes[nlayers];
+  for (int l = 0; l < nlayers; l++) {
+    for (int i = 0; i < sizes[l + 1] * sizes[l]; i++) t.w[l][i] = frand() - 0.5f;
+    for (int i = 0; i < sizes[l + 1]; i++) t.b[l][i] = frand() - 0.5f;
+  }
+  return t;
+}
+
+// Saves a dense network to disk.
+void xtsave(const Dense& t, const char* const path)
+{
+  File file = SPIFFS.open(path, FILE_WRITE);
+  if (!file) {
+    Serial.printf("%s - failed to open file for writing\n", path);
+    return;
+  }
+  // Save header: number of layers, sizes, activations.
+  file.printf("%d\n", t.nlayers);
+  for (int l = 0; l <= t.nlayers; l++) file.printf(l < t.nlayers ? "%d " : "%d\n", t.size[l]);
+  for (int l = 0; l < t.nlayers; l++) file.printf(l < t.nlayers - 1 ? "%d " : "%d\n", t.act[l]);
+  // Save biases and weights, layer by layer.
+  for (int l = 0; l < t.nlayers; l++) {
+    for (int i = 0; i < t.size[l + 1]; i++) file.printf("%f\n", (double) t.b[l][i]);
+    for (int i = 0; i < t.size[l + 1] * t.size[l]; i++) file.printf("%f\n", (double) t.w[l][i]);
+  }
+  file.close();
+}
+
+// Loads a dense network from disk.
+Dense xtloaddense(const char* const path)
+{
+  File file = SPIFFS.open(path);
+  if (!file || file.isDirectory()) {
+    Serial.printf("%s - failed to open file for reading\n", path);
+    while (1);
+  }
+  // Load header.
+  int nlayers = readIntFile (file);
+  if (nlayers < 1 || nlayers > DENSE_MAX_LAYERS) {
+    Serial.printf("%s - not a dense network\n", path);
+    while (1);
+  }
+  int sizes[DENSE_MAX_LAYERS + 1], acts[DENSE_MAX_LAYERS];
+  for (int l = 0; l <= nlayers; l++) sizes[l] = readIntFile (file);
+  for (int l = 0; l < nlayers; l++) acts[l] = readIntFile (file);
+  // Build a new network.
+  const Dense t = xtbuild(nlayers, sizes, acts);
+  // Load biases and weights.
+  for (int l = 0; l < nlayers; l++) {
+    for (int i = 0; i < sizes[l + 1]; i++) t.b[l][i] = readFloatFile (file);
+    for (int i = 0; i < sizes[l + 1] * sizes[l]; i++) t.w[l][i] = readFloatFile (file);
+  }
+  file.close();
+  return t;
+}
+
+// Frees object from heap.
+void xtfree(const Dense& t)
+{
+  free(t.arena);
+}
@@ -17,13 +17,34 @@ SSD1306 display(0x3c, 21, 22); // 0.96" OLED display (address, SDA, SCL)
 #include "FS.h"
 #include "SPIFFS.h"
 #include "Tinn.h"
+#include "Dense.h"
+#include "TinnBin.h"
+#include "TinnQ8.h"
+#include "dataset.h"
+#include "specview.h"
+#include "oled_flush.h"
+#include "sampler.h"
+#include "fft.h"
+#include "fft_q15.h"
+#include "ring.h"
+#include "capture.h"
+#include "pipeline.h"
+#include "stft.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #define FORMAT_SPIFFS_IF_FAILED true
+#if DATASET_BIN
+const char datasetFile[] = "/Data.bin";
+#else
 const char datasetFile[] = "/Data.txt";
+#endif
+#if NETWORK_BIN && !DENSE
+const char networkFile[] = "/Network.bin";
+#else
 const char networkFile[] = "/Network.txt";
+#endif
 #define BUTTON 19
 #define LEDPIN 2
 
@@ -31,27 +52,154 @@ const char networkFile[] = "/Network.txt";
 #define maxRows 1460
 #define maxInput 17
 #define Noutput 1
+#if !DATASET_BIN
 float input[maxRows][maxInput];
 float output[maxRows];
+#endif
 float recorded[maxInput];
 int bands = 0;
-unsigned long sampling_period_us, chrono;
-float complex sound[SAMPLES];
+unsigned long chrono;
+float complex sound[SAMPLES / 2]; // FFT bins of the real FFT
+stft_state stft;                  // sample history and spectrogram
 int LOG2SAMPLE = log(SAMPLES) / log(2);
+int8_t featuresQ8[maxInput];  // int8 features of the quantized network
+#if FIXED_POINT
+int16_t qsound[SAMPLES];   // Q15 samples, then FFT bins
+int qExponent = 0;         // block exponent of qsound
+q15_quant featureQuant[maxInput];  // int8 quantization of each feature
+#endif
+
+#if DENSE
+typedef Dense Network;
+#else
+typedef Tinn Network;
+#endif
+
+// Display sent in the background during the detection
+oled_flush oled;
 
 #include "init.h"
 #include "train_test.h"
 #include "sound_functions.h"
 
 // Declare the network
-Tinn tinn;
+Network tinn;
+#if FIXED_POINT && !DENSE
+TinnQ8 tinnQ8;  // int8 input layer, fed by the int8 features
+#endif
+
+// Network output for the features of a frame: the quantized network on
+// the int8 features with the fixed-point pipeline, else the float one
+float predict (const float *features, const int8_t *q8) {
+#if FIXED_POINT && !DENSE
+  return xtpredictq8(tinnQ8, q8)[0];
+#else
+  return xtpredict(tinn, features)[0];
+#endif
+}
+
+void showDetection (float score) {
+  char text[15];
+  sprintf(text, "%.0f%%", score * 100);
+  display.setFont(ArialMT_Plain_16);
+  display.setTextAlignment(TEXT_ALIGN_CENTER);
+  display.setColor(BLACK);
+  int x = 12;
+  display.fillRect(x, 8, display.width() - 2 * x, 37);
+  display.setColor(WHITE);
+  display.drawRect(x, 8, display.width() - 2 * x, 37);
+  display.drawString(64, 10, "DETECTION");
+  display.drawString(64, 25, text);
+  oled_present(&oled, display.buffer);
+  specview_invalidate(&spectrumView); // the spectrum is redrawn after
+}
+
+#if PIPELINE
+/*
+   Pipeline: capture -> window/FFT -> band features -> predict -> display
+   Capture and DSP on core 0, inference and display on core 1
+*/
+typedef struct {
+  unsigned long captured;     // capture time of the hop (capture_time)
+  int32_t bins[SAMPLES / 2];  // spectrum
+  int amp;                    // peak to peak amplitude
+  float features[maxInput];   // band features, amplitude
+  int8_t q8[maxInput];        // int8 features (FIXED_POINT)
+  float score;                // network output
+} pipeItem;
+frame_ring featureQueue, predictQueue, displayQueue;
+pipe_latency latency;  // from the capture of a hop to its display
+
+// The items are passed by pointer (pipeline.h): 2 in each of the 3
+// queues and 1 filled by the fft stage
+#define PIPE_ITEMS 8
+pipe_pool itemPool;
+
+bool fftStage (const void *in, void *out) {
+  static pipeItem *item = NULL;  // filled until a frame is complete
+  if (item == NULL) item = (pipeItem *) pipe_pool_take(&itemPool);
+  if (item == NULL) return false;  // none free: the hop is dropped
+  const uint16_t *hop = (const uint16_t *) in;
+  item->captured = capture_time(hop);
+  // Hops dropped by the capture (too slow): no frame across the gap
+  if (!capture_contiguous(hop)) restartAnalysis();
+  if (!analyseHop(hop, item->bins, &item->amp)) return false;
+  pipe_pass(out, item);
+  item = NULL;
+  return true;
+}
+
+bool featureStage (const void *in, void *out) {
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  bandFeatures(item->bins, item->amp, item->features, item->q8);
+  pipe_pass(out, item);
+  return true;
+}
+
+bool predictStage (const void *in, void *out) {
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  item->score = predict(item->features, item->q8);
+  pipe_pass(out, item);
+  return true;
+}
+
+bool displayStage (const void *in, void *out) {
+  (void) out;  // last stage
+  static unsigned long detected = 0, displayed = 0;
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  if (item->score > DETECT) {  // DETECTION !
+    detected = millis();
+    showDetection(item->score);
+  } else if (millis() - detected > 400ul && millis() - displayed >= DISPLAY_PERIOD) {
+    displayed = millis();
+    displaySpectrum(item->bins);
+  }
+  pipe_latency_add(&latency, item->captured);
+  pipe_pool_give(&itemPool, item);
+  return true;
+}
+
+pipe_stage stages[] = {
+  {"fft",      fftStage,     &captureRing,  &featureQueue, 0, {}},
+  {"features", featureStage, &featureQueue, &predictQueue, 0, {}},
+  {"predict",  predictStage, &predictQueue, &displayQueue, 1, {}},
+  {"display",  displayStage, &displayQueue, NULL,          1, {}}
+};
+#define NSTAGES (sizeof(stages) / sizeof(stages[0]))
+#endif
 
 void setup() {
   Serial.begin(115200);
   adc1_config_width(ADC_WIDTH_BIT_12);
   // ADC1 Channel 7 is GPIO 35 (microphone)
   adc1_config_channel_atten(ADC1_CHANNEL_7, ADC_ATTEN_DB_11);
-  sampling_period_us = round(1000ul * (1.0 / MAX_FREQ));
+  rfft_init(LOG2SAMPLE);
+#if FIXED_POINT
+  rfft_q15_init(LOG2SAMPLE);
+  if (!windowLeakInit()) Serial.println("Window leak table failed");
+#endif
+  // Hops of HOP samples analysed in overlapping frames of SAMPLES samples
+  if (!stft_init(&stft, SAMPLES, HOP, SAMPLES / 2, STFT_COLUMNS)) Serial.println("STFT failed");
   pinMode (BUTTON, INPUT_PULLUP);  // button on 19
   pinMode (LEDPIN, OUTPUT);
   if (!SPIFFS.begin(FORMAT_SPIFFS_IF_FAILED)) {
@@ -59,6 +207,7 @@ void setup() {
     return;
   }
   display.init();
+  initSpectrumView();
   splash();
   //  display.flipScreenVertically(); // Adjust to suit or remove
 
@@ -92,42 +241,73 @@ void setup() {
     display.drawString(64, 50, "--> LOADING NETWORK <--");
     display.display();
     delay(1500);
+#if DENSE
+    tinn = xtloaddense(networkFile);
+#elif NETWORK_BIN && defined(NETWORK_PARTITION)
+    if (!xtmappartition(tinn, NETWORK_PARTITION)) while (1);
+#elif NETWORK_BIN
+    if (!xtloadbin(tinn, networkFile)) while (1);
+#else
     tinn = xtload(networkFile);
+#endif
   }
 
   // Test the network
   testNetwork (tinn);
+#if FIXED_POINT && !DENSE
+  // int8 features calibrated on the range of the dataset read by the test
+  float top[maxInput], scale[maxInput];
+  int zero[maxInput];
+  datasetRange(tinn.nips, top);
+  xtcalibrate(top, tinn.nips, Q8_HEADROOM, ATT, scale, zero);
+  for (int i = 0; i < tinn.nips; i++) featureQuant[i] = q15_quant_init(scale[i], zero[i], ATT);
+  tinnQ8 = xtquantize(tinn, scale, zero);
+  if (tinnQ8.w == NULL) {
+    Serial.println("Network quantization failed");
+    while (1);
+  }
+#endif
+  // From now on the display is only sent by the service
+  oled_begin(&oled, 0x3c, display.width(), display.height(), DISPLAY_PERIOD);
+  // Hops of HOP samples at MAX_FREQ kHz, captured in the background
+  // once the network is ready
+  if (!capture_begin(MAX_FREQ * 1000ul, HOP)) Serial.println("Capture failed");
   chrono = millis();
+#if PIPELINE
+  ring_init(&featureQueue, 2, sizeof(void *));
+  ring_init(&predictQueue, 2, sizeof(void *));
+  ring_init(&displayQueue, 2, sizeof(void *));
+  if (!pipe_pool_init(&itemPool, PIPE_ITEMS, sizeof(pipeItem)) || !pipe_start(stages, NSTAGES)) Serial.println("Pipeline start failed");
+#endif
 }
 
+#if PIPELINE
 void loop() {
-  digitalWrite(LEDPIN, LOW);
-  acquisition();
-  // Test each 1000 ms
-  if (millis() - chrono > 1000ul) {
+  // The stages run in their tasks: report their statistics each 10 s
+  if (millis() - chrono > 10000ul) {
     chrono = millis();
-    //    Data data = ndata(tinn.nips, tinn.nops, 1);
-    //    for (int col = 0; col < tinn.nips; col++)
-    //      data.in[0][col] = recorded[col];
-    //    const float* const in = data.in[0];
-    //    const float* const pd = xtpredict(tinn, in);
-    const float* const pd = xtpredict(tinn, recorded);
-    if (pd[0] > DETECT) {  // DETECTION !
-      Serial.printf ("Score : %.2f DETECTION\n", pd[0]);
+    pipe_report(stages, NSTAGES);
+    pipe_latency_report(&latency);
+    printf("Frames captured: %lu, dropped: %lu\n", capture_frames(), capture_overruns());
+  }
+  delay(100);
+}
+#else
+
+void loop() {
+  digitalWrite(LEDPIN, LOW);
+  // Test each new STFT frame
+  if (acquisition()) {
+    const float score = predict(recorded, featuresQ8);
+    if (score > DETECT) {  // DETECTION !
+      Serial.printf ("Score : %.2f DETECTION\n", score);
       digitalWrite(LEDPIN, HIGH);
-      char text[15];
-      sprintf(text, "%.0f%%", pd[0] * 100);
-      display.setFont(ArialMT_Plain_16);
-      display.setTextAlignment(TEXT_ALIGN_CENTER);
-      display.setColor(BLACK);
-      int x = 12;
-      display.fillRect(x, 8, display.width() - 2 * x, 37);
-      display.setColor(WHITE);
-      display.drawRect(x, 8, display.width() - 2 * x, 37);
-      display.drawString(64, 10, "DETECTION");
-      display.drawString(64, 25, text);
-      display.display();
+      showDetection(score);
       delay(400);
+      // The sound of the pause is not analysed: new frames from new hops
+      capture_skip();
+      restartAnalysis();
     }
   }
 }
+#endif
@@ -1,6 +1,24 @@
 /*
    functions from the TINN neural network library
+
+   The input to hidden weights are stored by blocks of TINN_BLOCK hidden
+   neurons: inside a block, the TINN_BLOCK weights of input j follow each
+   other (see widx). The forward pass reads each input once per block and
+   updates TINN_BLOCK independent sums, held in a GCC vector (tinn_vec):
+   SSE / AVX registers on the host, plain registers on the ESP32. The number of hidden neurons
+   is padded to a multiple of TINN_BLOCK, the number of inputs to a
+   multiple of TINN_PAD, with zero weights. The files keep the order of
+   the original library.
 */
+#ifndef TINN_BLOCK
+#define TINN_BLOCK 4 // hidden neurons computed per pass over the inputs
+#endif
+#ifndef TINN_PAD
+#define TINN_PAD 4   // the inputs are padded to a multiple of TINN_PAD
+#endif
+
+// TINN_BLOCK floats, loaded from any float address.
+typedef float tinn_vec __attribute__((vector_size(TINN_BLOCK * sizeof(float)), aligned(sizeof(float))));
 
 typedef struct
 {
@@ -24,9 +42,29 @@ typedef struct
   int nhid;
   // Number of outputs.
   int nops;
+  // Number of inputs, padded.
+  int ldw;
+  // Number of hidden neurons, padded.
+  int nhidp;
+  // Padded input.
+  float* in;
+  // Gradient of the weights, same layout (BATCHED, else NULL).
+  float* g;
+  // Work space of xttrainbatch, batches of up to BATCH samples (BATCHED,
+  // else NULL).
+  float* work;
+  // Weights used in place from a mapped network (TinnBin.h): read only,
+  // not freed.
+  bool mapped;
 }
 Tinn;
 
+// Index of the weight from input j to hidden neuron i.
+static inline int widx(const Tinn& t, const int i, const int j)
+{
+  return (i / TINN_BLOCK) * t.ldw * TINN_BLOCK + j * TINN_BLOCK + i % TINN_BLOCK;
+}
+
 // Computes error.
 static float err(const float a, const float b)
 {
@@ -48,17 +86,12 @@ static float toterr(const float* const tg, const float* const o, const int size)
   return sum;
 }
 
-// Activation function.
-static float act(const float a, int actNumber)
+// Activation function, resolved at compile time.
+template <int actNumber>
+static inline float actT(const float a)
 {
-  switch (actNumber) {
-    case SIGMOID:
-      return 1.0f / (1.0f + expf(-a));
-      break;
-    case RELU:
-      return (a > 0) ? a : 0;
-      break;
-  }
+  if (actNumber == SIGMOID) return 1.0f / (1.0f + expf(-a));
+  return (a > 0) ? a : 0;
 }
 
 // Returns partial derivative of activation function.
@@ -69,10 +102,19 @@ static float pdact(const float a, int actNumber)
       return a * (1.0f - a);
       break;
     case RELU:
+    default:
       return (a > 0) ? 1 : 0;
   }
 }
 
+// Partial derivative of activation function, resolved at compile time.
+template <int actNumber>
+static inline float pdactT(const float a)
+{
+  if (actNumber == SIGMOID) return a * (1.0f - a);
+  return (a > 0) ? 1 : 0;
+}
+
 // Returns floating point random from 0.0 - 1.0.
 static float frand()
 {
@@ -96,20 +138,26 @@ static void bprop(const Tinn t, const float* const in, const float* const tg, fl
     }
     // Correct weights in input to hidden layer.
     for (int j = 0; j < t.nips; j++)
-      t.w[i * t.nips + j] -= rate * sum * pdact(t.h[i], ACTIVATION) * in[j];
+      t.w[widx(t, i, j)] -= rate * sum * pdact(t.h[i], ACTIVATION) * in[j];
   }
 }
 
 // Performs forward propagation.
-static void fprop(const Tinn t, const float* const in)
+template <int hiddenAct>
+static void fpropT(const Tinn t, const float* const input)
 {
-  // Calculate hidden layer neuron values.
-  for (int i = 0; i < t.nhid; i++)
+  // Padded copy of the input.
+  float* const in = t.in;
+  for (int j = 0; j < t.nips; j++) in[j] = input[j];
+  // Calculate hidden layer neuron values, TINN_BLOCK at a time.
+  for (int i = 0; i < t.nhidp; i += TINN_BLOCK)
   {
-    float sum = 0.0f;
-    for (int j = 0; j < t.nips; j++)
-      sum += in[j] * t.w[i * t.nips + j];
-    t.h[i] = act(sum + t.b[0], ACTIVATION);
+    const tinn_vec* const w = (const tinn_vec*) (t.w + i * t.ldw);
+    tinn_vec sum = {0.0f};
+    for (int j = 0; j < t.ldw; j++)
+      sum += in[j] * w[j];
+    for (int k = 0; k < TINN_BLOCK; k++)
+      t.h[i + k] = actT<hiddenAct>(sum[k] + t.b[0]);
   }
   // Calculate output layer neuron values.
   for (int i = 0; i < t.nops; i++)
@@ -117,14 +165,117 @@ static void fprop(const Tinn t, const float* const in)
     float sum = 0.0f;
     for (int j = 0; j < t.nhid; j++)
       sum += t.h[j] * t.x[i * t.nhid + j];
-    t.o[i] = act(sum + t.b[1], SIGMOID); // SIGMOID at output layer
+    t.o[i] = actT<SIGMOID>(sum + t.b[1]); // SIGMOID at output layer
   }
 }
 
+static void fprop(const Tinn t, const float* const in)
+{
+  fpropT<ACTIVATION>(t, in);
+}
+
+// Size of the weights, padding included.
+static int xtwsize(const Tinn t)
+{
+  return t.nhidp * t.ldw + t.nhid * t.nops;
+}
+
+// Floats of work space used by xtgrad for n samples.
+int xtworksize(const Tinn t, const int n)
+{
+  return n * (t.nhidp + t.nops);
+}
+
+// Forward and backward propagation of n samples at once, as matrix
+// products: the hidden and output values of the whole batch are kept in
+// work (xtworksize floats), the gradient of the error is added to grad
+// (xtwsize floats, zeroed by the caller) and the weights are not changed.
+// Returns the sum of the errors of the samples.
+template <int hiddenAct>
+static float xtgradT(const Tinn t, const float* const* in, const float* const* tg,
+                     const int n, float* const grad, float* const work)
+{
+  float* const H = work;                  // n x nhidp hidden values, then deltas
+  float* const O = work + n * t.nhidp;    // n x nops output deltas
+  float* const gx = grad + t.nhidp * t.ldw;
+  // Hidden layer: each block of weights is used for the whole batch.
+  for (int i = 0; i < t.nhidp; i += TINN_BLOCK)
+  {
+    const tinn_vec* const w = (const tinn_vec*) (t.w + i * t.ldw);
+    for (int s = 0; s < n; s++)
+    {
+      const float* const x = in[s];
+      tinn_vec sum = {0.0f};
+      for (int j = 0; j < t.nips; j++)
+        sum += x[j] * w[j];
+      for (int k = 0; k < TINN_BLOCK; k++)
+        H[s * t.nhidp + i + k] = actT<hiddenAct>(sum[k] + t.b[0]);
+    }
+  }
+  // Output layer and its deltas.
+  float error = 0.0f;
+  for (int s = 0; s < n; s++)
+    for (int k = 0; k < t.nops; k++)
+    {
+      float sum = 0.0f;
+      for (int i = 0; i < t.nhid; i++)
+        sum += H[s * t.nhidp + i] * t.x[k * t.nhid + i];
+      const float o = actT<SIGMOID>(sum + t.b[1]); // SIGMOID at output layer
+      error += err(tg[s][k], o);
+      O[s * t.nops + k] = pderr(o, tg[s][k]) * pdactT<SIGMOID>(o);
+    }
+  // Hidden to output gradient, then hidden deltas in place of H.
+  for (int s = 0; s < n; s++)
+    for (int i = 0; i < t.nhidp; i++)
+    {
+      float* const h = H + s * t.nhidp + i;
+      if (i >= t.nhid) {
+        *h = 0.0f;
+        continue;
+      }
+      float sum = 0.0f;
+      for (int k = 0; k < t.nops; k++)
+      {
+        const float d = O[s * t.nops + k];
+        gx[k * t.nhid + i] += d * *h;
+        sum += d * t.x[k * t.nhid + i];
+      }
+      *h = sum * pdactT<hiddenAct>(*h);
+    }
+  // Input to hidden gradient, one block of neurons at a time.
+  for (int i = 0; i < t.nhidp; i += TINN_BLOCK)
+  {
+    tinn_vec* const g = (tinn_vec*) (grad + i * t.ldw);
+    for (int s = 0; s < n; s++)
+    {
+      const float* const x = in[s];
+      const tinn_vec d = *(const tinn_vec*) (H + s * t.nhidp + i);
+      for (int j = 0; j < t.nips; j++)
+        g[j] += x[j] * d;
+    }
+  }
+  return error;
+}
+
+float xtgrad(const Tinn t, const float* const* in, const float* const* tg,
+             const int n, float* const grad, float* const work)
+{
+  return xtgradT<ACTIVATION>(t, in, tg, n, grad, work);
+}
+
+// Applies a gradient (xtgrad) with a learning rate.
+void xtapply(const Tinn t, const float* const grad, float rate)
+{
+  const int size = xtwsize(t);
+  for (int i = 0; i < size; i++) t.w[i] -= rate * grad[i];
+}
+
 // Randomizes tinn weights and biases.
 static void wbrand(const Tinn t)
 {
-  for (int i = 0; i < t.nw; i++) t.w[i] = frand() - 0.5f;
+  for (int i = 0; i < t.nhid; i++)
+    for (int j = 0; j < t.nips; j++) t.w[widx(t, i, j)] = frand() - 0.5f;
+  for (int i = 0; i < t.nhid * t.nops; i++) t.x[i] = frand() - 0.5f;
   for (int i = 0; i < t.nb; i++) t.b[i] = frand() - 0.5f;
 }
 
@@ -143,6 +294,20 @@ float xttrain(const Tinn t, const float* const in, const float* const tg, float
   return toterr(tg, t.o, t.nops);
 }
 
+// Trains a tinn with a batch of n <= BATCH inputs and target outputs:
+// the gradients of the samples are averaged and the weights updated
+// once, so that the learning rate of xttrain applies (LR). Needs
+// BATCHED. Returns the sum of the target to output errors.
+float xttrainbatch(const Tinn t, const float* const* in, const float* const* tg,
+                   const int n, float rate)
+{
+  if (t.g == NULL || t.work == NULL || n < 1 || n > BATCH) return 0.0f;
+  memset(t.g, 0, xtwsize(t) * sizeof(float));
+  const float error = xtgrad(t, in, tg, n, t.g, t.work);
+  xtapply(t, t.g, rate / n);
+  return error;
+}
+
 // Constructs a tinn with number of inputs, number of hidden neurons, and number of outputs
 Tinn xtbuild(const int nips, const int nhid, const int nops)
 {
@@ -150,14 +315,25 @@ Tinn xtbuild(const int nips, const int nhid, const int nops)
   // Tinn only supports one hidden layer so there are two biases.
   t.nb = 2;
   t.nw = nhid * (nips + nops);
-  t.w = (float*) calloc(t.nw, sizeof(*t.w));
-  t.x = t.w + nhid * nips;
+  t.ldw = (nips + TINN_PAD - 1) / TINN_PAD * TINN_PAD;
+  t.nhidp = (nhid + TINN_BLOCK - 1) / TINN_BLOCK * TINN_BLOCK;
+  t.w = (float*) calloc(t.nhidp * t.ldw + nhid * nops, sizeof(*t.w));
+  t.x = t.w + t.nhidp * t.ldw;
   t.b = (float*) calloc(t.nb, sizeof(*t.b));
-  t.h = (float*) calloc(nhid, sizeof(*t.h));
+  t.h = (float*) calloc(t.nhidp, sizeof(*t.h));
   t.o = (float*) calloc(nops, sizeof(*t.o));
+  t.in = (float*) calloc(t.ldw, sizeof(*t.in));
   t.nips = nips;
   t.nhid = nhid;
   t.nops = nops;
+#if BATCHED
+  t.g = (float*) calloc(xtwsize(t), sizeof(*t.g));
+  t.work = (float*) malloc(xtworksize(t, BATCH) * sizeof(*t.work));
+#else
+  t.g = NULL;
+  t.work = NULL;
+#endif
+  t.mapped = false;
   wbrand(t);
   return t;
 }
@@ -174,7 +350,9 @@ void xtsave(const Tinn t, const char* const path)
   file.printf("%d %d %d\n", t.nips, t.nhid, t.nops);
   // Save biases and weights.
   for (int i = 0; i < t.nb; i++) file.printf("%f\n", (double) t.b[i]);
-  for (int i = 0; i < t.nw; i++) file.printf("%f\n", (double) t.w[i]);
+  for (int i = 0; i < t.nhid; i++)
+    for (int j = 0; j < t.nips; j++) file.printf("%f\n", (double) t.w[widx(t, i, j)]);
+  for (int i = 0; i < t.nhid * t.nops; i++) file.printf("%f\n", (double) t.x[i]);
   file.close();
 }
 
@@ -227,9 +405,15 @@ float readFloatFile (File file) {
         break;
       case 46: // .
         {
-          frac = readIntFile (file);
-          int n = log10(frac) + 1;
-          val = sign * (integ + frac / pow(10, n));
+          // Fractional part, leading zeros included
+          float scale = 1.0f;
+          while (file.available()) {
+            c = file.read();
+            if (c < '0' || c > '9') break;
+            scale /= 10;
+            frac = frac * 10 + c - '0';
+          }
+          val = sign * (integ + frac * scale);
           return val;
           break;
         }
@@ -262,7 +446,9 @@ Tinn xtload(const char* const path)
   const Tinn t = xtbuild(nips, nhid, nops);
   // Load biases and weights.
   for (int i = 0; i < t.nb; i++) t.b[i] = readFloatFile (file);
-  for (int i = 0; i < t.nw; i++) t.w[i] = readFloatFile (file);
+  for (int i = 0; i < t.nhid; i++)
+    for (int j = 0; j < t.nips; j++) t.w[widx(t, i, j)] = readFloatFile (file);
+  for (int i = 0; i < t.nhid * t.nops; i++) t.x[i] = readFloatFile (file);
   file.close();
   return t;
 }
@@ -270,10 +456,13 @@ Tinn xtload(const char* const path)
 // Frees object from heap.
 void xtfree(const Tinn t)
 {
-  free(t.w);
+  if (!t.mapped) free(t.w);
   free(t.b);
   free(t.h);
   free(t.o);
+  free(t.in);
+  free(t.g);
+  free(t.work);
 }
 
 // Prints an array of floats. Useful for printing predictions.
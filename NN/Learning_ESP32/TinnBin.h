@@ -0,0 +1,344 @@
+/*
+   Binary network file, instead of the text /Network.txt
+
+   A 64 bytes header, then the weights:
+
+     offset  size
+          0     4  magic "TINN"
+          4     2  version (1)
+          6     2  type of the weights: 0 float, 1 int8
+          8    12  nips, nhid, nops
+         20     4  activation of the hidden layer (SIGMOID, RELU)
+         24    12  block, ldw, nhidp: layout of the input to hidden weights
+         36     8  the 2 biases (float)
+         44     8  int8: scales of the input to hidden and of the hidden
+                   to output weights (weight = q * scale)
+         52     4  size of the weights in bytes
+         56     4  CRC-32 of the weights
+         60     4  reserved
+         64        nhidp * ldw input to hidden weights, by blocks of
+                   `block` neurons (see widx in Tinn.h), zero padding
+                   included, then nhid * nops hidden to output weights
+
+   Everything is little endian, like the ESP32 and the PC. The float
+   weights are the memory image of Tinn.w: when the block size and the
+   padding match the ones of Tinn.h, the network is used in place from a
+   mapped file or flash partition (xtmapbin), nothing is parsed or
+   copied. The int8 weights take 4 times less space and are converted to
+   float when loaded.
+
+   To use the weights in place on the ESP32, add a data partition to the
+   partition table, for instance:
+       network, data, 0x40, , 64K
+   copy the file into it once (xtflashbin), then map it at each boot
+   (xtmappartition). The flash is read only: a mapped network can predict
+   but not be trained.
+
+   Needs Tinn.h.
+*/
+#include <stdint.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <esp_partition.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TINN_BIN_MAGIC 0x4E4E4954u  // "TINN"
+#define TINN_BIN_VERSION 1
+#define TINN_BIN_FLOAT 0
+#define TINN_BIN_INT8 1
+#define TINN_BIN_HEADER 64          // header size, alignment of the weights
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t dtype;
+  int32_t nips, nhid, nops;
+  int32_t act;
+  int32_t block, ldw, nhidp;
+  float b[2];
+  float scale[2];
+  uint32_t size;
+  uint32_t crc;
+  uint32_t reserved;
+}
+tinn_bin_header;
+
+static_assert(sizeof(tinn_bin_header) == TINN_BIN_HEADER, "tinn_bin_header must be 64 bytes");
+
+// CRC-32 (IEEE, as zlib), continued from crc (0 at the beginning).
+static uint32_t tinn_crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+// Number of weights in the file, padding included.
+static size_t tinn_bin_count(const tinn_bin_header* h)
+{
+  return (size_t) h->nhidp * h->ldw + (size_t) h->nhid * h->nops;
+}
+
+// Checks the header of a network file.
+static bool tinn_bin_check(const tinn_bin_header* h, const char* const name)
+{
+  if (h->magic != TINN_BIN_MAGIC || h->version != TINN_BIN_VERSION) {
+    Serial.printf("%s - not a network file\n", name);
+    return false;
+  }
+  if (h->nips <= 0 || h->nhid <= 0 || h->nops <= 0 || h->block <= 0
+      || h->ldw < h->nips || h->nhidp < h->nhid || h->nhidp % h->block != 0
+      || (h->dtype != TINN_BIN_FLOAT && h->dtype != TINN_BIN_INT8)
+      || h->size != tinn_bin_count(h) * ((h->dtype == TINN_BIN_FLOAT) ? sizeof(float) : 1)) {
+    Serial.printf("%s - bad network header\n", name);
+    return false;
+  }
+  // The weights were trained for another hidden activation
+  if (h->act != ACTIVATION) {
+    Serial.printf("%s - hidden activation %d, the sketch uses %d\n", name, h->act, ACTIVATION);
+    return false;
+  }
+  return true;
+}
+
+// Value of the weight n of the file.
+static float tinn_bin_weight(const tinn_bin_header* h, const uint8_t* data, size_t n, int part)
+{
+  if (h->dtype == TINN_BIN_INT8) return (int8_t) data[n] * h->scale[part];
+  float v;
+  memcpy(&v, data + n * sizeof(float), sizeof(float));
+  return v;
+}
+
+// Copies the weights of the file into a tinn built with the same
+// dimensions, whatever the layout of the file.
+static void tinn_bin_fill(const Tinn t, const tinn_bin_header* h, const uint8_t* data)
+{
+  const int B = h->block;
+  for (int i = 0; i < t.nhid; i++)
+    for (int j = 0; j < t.nips; j++)
+      t.w[widx(t, i, j)] = tinn_bin_weight(h, data, (size_t) (i / B) * h->ldw * B + j * B + i % B, 0);
+  const size_t x = (size_t) h->nhidp * h->ldw;
+  for (int i = 0; i < t.nhid * t.nops; i++) t.x[i] = tinn_bin_weight(h, data, x + i, 1);
+  t.b[0] = h->b[0];
+  t.b[1] = h->b[1];
+}
+
+// True if the float weights of the file are the memory image of Tinn.w.
+static bool tinn_bin_inplace(const tinn_bin_header* h)
+{
+  return h->dtype == TINN_BIN_FLOAT && h->block == TINN_BLOCK
+         && h->ldw == (h->nips + TINN_PAD - 1) / TINN_PAD * TINN_PAD
+         && h->nhidp == (h->nhid + TINN_BLOCK - 1) / TINN_BLOCK * TINN_BLOCK;
+}
+
+// Saves a tinn in the binary format, float (TINN_BIN_FLOAT) or int8
+// (TINN_BIN_INT8) weights.
+bool xtsavebin(const Tinn t, const char* const path, const int dtype)
+{
+  tinn_bin_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = TINN_BIN_MAGIC;
+  h.version = TINN_BIN_VERSION;
+  h.dtype = dtype;
+  h.nips = t.nips;
+  h.nhid = t.nhid;
+  h.nops = t.nops;
+  h.act = ACTIVATION;
+  h.block = TINN_BLOCK;
+  h.ldw = t.ldw;
+  h.nhidp = t.nhidp;
+  h.b[0] = t.b[0];
+  h.b[1] = t.b[1];
+  const size_t count = tinn_bin_count(&h);
+  const size_t nw = (size_t) t.nhidp * t.ldw;
+  const uint8_t* data = (const uint8_t*) t.w;  // w, then x
+  int8_t* q = NULL;
+  if (dtype == TINN_BIN_INT8) {
+    // Symmetric quantization, one scale per weight matrix
+    q = (int8_t*) malloc(count);
+    if (q == NULL) return false;
+    for (int part = 0; part < 2; part++) {
+      const size_t first = part ? nw : 0, last = part ? count : nw;
+      float top = 0.0f;
+      for (size_t i = first; i < last; i++)
+        if (fabsf(t.w[i]) > top) top = fabsf(t.w[i]);
+      h.scale[part] = (top > 0) ? top / 127.0f : 1.0f;
+      for (size_t i = first; i < last; i++) q[i] = lroundf(t.w[i] / h.scale[part]);
+    }
+    data = (const uint8_t*) q;
+    h.size = count;
+  } else {
+    h.scale[0] = h.scale[1] = 1.0f;
+    h.size = count * sizeof(float);
+  }
+  h.crc = tinn_crc32(0, data, h.size);
+
+  File file = SPIFFS.open(path, FILE_WRITE);
+  bool ok = file;
+  if (ok) {
+    ok = file.write((const uint8_t*) &h, sizeof(h)) == sizeof(h)
+         && file.write(data, h.size) == h.size;
+    file.close();
+  }
+  if (!ok) Serial.printf("%s - failed to write the network\n", path);
+  free(q);
+  return ok;
+}
+
+// Loads a binary network into RAM: the float weights are read straight
+// into the tinn, the int8 weights converted.
+bool xtloadbin(Tinn& t, const char* const path)
+{
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file || file.isDirectory()) {
+    Serial.printf("%s - failed to open file for reading\n", path);
+    return false;
+  }
+  tinn_bin_header h;
+  bool ok = file.read((uint8_t*) &h, sizeof(h)) == sizeof(h) && tinn_bin_check(&h, path);
+  if (!ok) {
+    file.close();
+    return false;
+  }
+  t = xtbuild(h.nips, h.nhid, h.nops);
+  uint8_t* data = tinn_bin_inplace(&h) ? (uint8_t*) t.w : (uint8_t*) malloc(h.size);
+  ok = data != NULL && file.read(data, h.size) == h.size;
+  file.close();
+  if (ok && tinn_crc32(0, data, h.size) != h.crc) {
+    Serial.printf("%s - CRC error\n", path);
+    ok = false;
+  }
+  if (ok && data == (uint8_t*) t.w) {
+    t.b[0] = h.b[0];
+    t.b[1] = h.b[1];
+  } else if (ok) tinn_bin_fill(t, &h, data);
+  if (data != (uint8_t*) t.w) free(data);
+  if (!ok) xtfree(t);
+  return ok;
+}
+
+// Uses a binary network in memory (mapped file or flash partition), of
+// size bytes at most. The float weights are used in place when their
+// layout matches, else the network is copied into RAM.
+bool xtmapbin(Tinn& t, const void* const image, const size_t size, const char* const name)
+{
+  const tinn_bin_header* h = (const tinn_bin_header*) image;
+  if (size < sizeof(*h) || !tinn_bin_check(h, name)) return false;
+  if (size < sizeof(*h) + h->size) {
+    Serial.printf("%s - truncated network\n", name);
+    return false;
+  }
+  const uint8_t* data = (const uint8_t*) image + TINN_BIN_HEADER;
+  if (tinn_crc32(0, data, h->size) != h->crc) {
+    Serial.printf("%s - CRC error\n", name);
+    return false;
+  }
+  if (!tinn_bin_inplace(h)) {
+    t = xtbuild(h->nips, h->nhid, h->nops);
+    tinn_bin_fill(t, h, data);
+    return true;
+  }
+  // Only the biases and the layer values in RAM.
+  t.nb = 2;
+  t.nw = h->nhid * (h->nips + h->nops);
+  t.nips = h->nips;
+  t.nhid = h->nhid;
+  t.nops = h->nops;
+  t.ldw = h->ldw;
+  t.nhidp = h->nhidp;
+  t.w = (float*) data;
+  t.x = t.w + t.nhidp * t.ldw;
+  t.b = (float*) calloc(t.nb, sizeof(*t.b));
+  t.h = (float*) calloc(t.nhidp, sizeof(*t.h));
+  t.o = (float*) calloc(t.nops, sizeof(*t.o));
+  t.in = (float*) calloc(t.ldw, sizeof(*t.in));
+  t.g = NULL;
+  t.work = NULL;
+  t.mapped = true;
+  if (!t.b || !t.h || !t.o || !t.in) {
+    xtfree(t);
+    return false;
+  }
+  t.b[0] = h->b[0];
+  t.b[1] = h->b[1];
+  return true;
+}
+
+#ifdef ARDUINO
+// Copies a binary network file into the flash partition `label`.
+bool xtflashbin(const char* const path, const char* const label)
+{
+  const esp_partition_t* part =
+    esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  File file = SPIFFS.open(path, FILE_READ);
+  if (part == NULL || !file) {
+    Serial.printf("%s, %s - no such file or partition\n", path, label);
+    return false;
+  }
+  const size_t size = file.size();
+  if (size > part->size
+      || esp_partition_erase_range(part, 0, (size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1)) != ESP_OK) {
+    Serial.printf("%s - cannot write %u bytes\n", label, size);
+    file.close();
+    return false;
+  }
+  uint8_t buf[256];
+  bool ok = true;
+  for (size_t pos = 0; ok && pos < size; ) {
+    const size_t n = file.read(buf, sizeof(buf));
+    ok = n > 0 && esp_partition_write(part, pos, buf, n) == ESP_OK;
+    pos += n;
+  }
+  file.close();
+  return ok;
+}
+
+// Maps the network of the flash partition `label` and uses it in place.
+// The mapping is kept until the reset.
+bool xtmappartition(Tinn& t, const char* const label)
+{
+  const esp_partition_t* part =
+    esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  tinn_bin_header h;
+  if (part == NULL || esp_partition_read(part, 0, &h, sizeof(h)) != ESP_OK
+      || !tinn_bin_check(&h, label) || sizeof(h) + h.size > part->size) return false;
+  const void* image;
+  spi_flash_mmap_handle_t handle;
+  if (esp_partition_mmap(part, 0, sizeof(h) + h.size, SPI_FLASH_MMAP_DATA, &image, &handle) != ESP_OK) {
+    Serial.printf("%s - mapping failed\n", label);
+    return false;
+  }
+  if (xtmapbin(t, image, sizeof(h) + h.size, label)) return true;
+  spi_flash_munmap(handle);
+  return false;
+}
+#else
+// Maps a binary network file and uses it in place. The mapping is kept
+// until the end of the program.
+bool xtmapfile(Tinn& t, const char* const path)
+{
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    Serial.printf("%s - failed to open file for reading\n", path);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  void* image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) return false;
+  if (xtmapbin(t, image, st.st_size, path)) return true;
+  munmap(image, st.st_size);
+  return false;
+}
+#endif
@@ -0,0 +1,142 @@
+/*
+   Quantized tinn, for the int8 features of the fixed-point pipeline
+
+   The inputs are the int8 features of bandFeatures (FIXED_POINT), each
+   with its own scale and zero point, feature j = (q_j - zero_j) *
+   scale_j, calibrated on the range of the recorded features
+   (xtcalibrate). The scale of an input is folded into its weights,
+   which are then quantized to int8, one symmetric scale per hidden
+   neuron, in the block layout of Tinn.w (see widx in Tinn.h). The sum
+   of a hidden neuron is an integer dot product:
+
+     sum_j w_j x_j = wscale * (sum_j qw_j q_j - sum_j qw_j zero_j)
+
+   with qw_j = w_j scale_j / wscale; the second term is computed once by
+   xtquantize, so a frame costs nips x nhid 8-bit multiplies into int32
+   accumulators and one float product per neuron. The activation and
+   the hidden to output layer (nhid x nops weights) stay in float, in
+   the buffers of the tinn.
+
+   Needs Tinn.h.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct
+{
+  // The float tinn: biases, hidden to output weights, layer values.
+  Tinn t;
+  // Input to hidden weights, layout of Tinn.w.
+  int8_t* w;
+  // Per hidden neuron: weight scale.
+  float* scale;
+  // Per hidden neuron: sum of its weights times the input zero points.
+  int32_t* zsum;
+  // Per input: feature = (q - inZero) * inScale.
+  float* inScale;
+  int32_t* inZero;
+}
+TinnQ8;
+
+// Frees the quantized weights (not the tinn).
+void xtfreeq8(const TinnQ8 q)
+{
+  free(q.w);
+  free(q.scale);
+  free(q.zsum);
+  free(q.inScale);
+  free(q.inZero);
+}
+
+// Input quantization from the range of each input over recorded data
+// (features not negative): 0 ... headroom x top[j] is mapped on -128 ...
+// 127, in steps of at least 1 / att (the resolution of the integer
+// features). Louder inputs are clamped.
+void xtcalibrate(const float* const top, const int nips, const float headroom, const float att,
+                 float* const scale, int* const zero)
+{
+  for (int j = 0; j < nips; j++)
+  {
+    scale[j] = headroom * top[j] / 255.0f;
+    if (scale[j] < 1.0f / att) scale[j] = 1.0f / att;
+    zero[j] = -128;
+  }
+}
+
+// Quantizes the input to hidden weights of a tinn, for inputs of scales
+// inScale and zero points inZero (xtcalibrate). The tinn is used (not
+// copied) and must be kept. Returns w == NULL if the memory is missing.
+TinnQ8 xtquantize(const Tinn t, const float* const inScale, const int* const inZero)
+{
+  TinnQ8 q;
+  q.t = t;
+  q.w = (int8_t*) calloc(t.nhidp * t.ldw, sizeof(*q.w));
+  q.scale = (float*) calloc(t.nhidp, sizeof(*q.scale));
+  q.zsum = (int32_t*) calloc(t.nhidp, sizeof(*q.zsum));
+  q.inScale = (float*) malloc(t.nips * sizeof(*q.inScale));
+  q.inZero = (int32_t*) malloc(t.nips * sizeof(*q.inZero));
+  if (q.w == NULL || q.scale == NULL || q.zsum == NULL || q.inScale == NULL || q.inZero == NULL) {
+    xtfreeq8(q);
+    q.w = NULL;
+    return q;
+  }
+  for (int j = 0; j < t.nips; j++)
+  {
+    q.inScale[j] = inScale[j];
+    q.inZero[j] = inZero[j];
+  }
+  for (int i = 0; i < t.nhid; i++)
+  {
+    // Weights for the int8 inputs, the input scales folded in
+    float top = 0.0f;
+    for (int j = 0; j < t.nips; j++)
+      if (fabsf(t.w[widx(t, i, j)] * inScale[j]) > top) top = fabsf(t.w[widx(t, i, j)] * inScale[j]);
+    const float wscale = (top > 0) ? top / 127.0f : 1.0f;
+    int32_t zsum = 0;
+    for (int j = 0; j < t.nips; j++)
+    {
+      const int8_t w = lroundf(t.w[widx(t, i, j)] * inScale[j] / wscale);
+      q.w[widx(t, i, j)] = w;
+      zsum += w * inZero[j];
+    }
+    q.scale[i] = wscale;
+    q.zsum[i] = zsum;
+  }
+  return q;
+}
+
+// Quantizes float inputs (the features / ATT) as bandFeatures does.
+void xtquantizeinput(const TinnQ8& q, const float* const in, int8_t* const out)
+{
+  for (int j = 0; j < q.t.nips; j++)
+  {
+    const long v = lroundf(in[j] / q.inScale[j]) + q.inZero[j];
+    out[j] = (v > 127) ? 127 : (v < -128) ? -128 : v;
+  }
+}
+
+// Returns an output prediction given int8 inputs.
+float* xtpredictq8(const TinnQ8& q, const int8_t* const in)
+{
+  const Tinn& t = q.t;
+  // Hidden layer: TINN_BLOCK integer sums per pass over the inputs.
+  for (int i = 0; i < t.nhidp; i += TINN_BLOCK)
+  {
+    const int8_t* const w = q.w + i * t.ldw;
+    int32_t sum[TINN_BLOCK] = {0};
+    for (int j = 0; j < t.nips; j++)
+      for (int k = 0; k < TINN_BLOCK; k++)
+        sum[k] += w[j * TINN_BLOCK + k] * in[j];
+    for (int k = 0; k < TINN_BLOCK; k++)
+      t.h[i + k] = actT<ACTIVATION>(q.scale[i + k] * (sum[k] - q.zsum[i + k]) + t.b[0]);
+  }
+  // Output layer, as fpropT.
+  for (int i = 0; i < t.nops; i++)
+  {
+    float sum = 0.0f;
+    for (int j = 0; j < t.nhid; j++)
+      sum += t.h[j] * t.x[i * t.nhid + j];
+    t.o[i] = actT<SIGMOID>(sum + t.b[1]); // SIGMOID at output layer
+  }
+  return t.o;
+}
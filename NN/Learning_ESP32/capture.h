@@ -0,0 +1,326 @@
+/*
+   Sound capture in the background
+
+   Frames of captureSize samples are taken at a fixed rate by the
+   hardware and written in place into the slots of a lock-free frame
+   ring (ring.h). The DSP stage takes the oldest full frame (capture_wait
+   or capture_frame), reads it and gives it back (capture_release),
+   while the next frames are captured. If the DSP stage is too slow and
+   the ring is full, the new frames are dropped and counted
+   (capture_overruns) instead of being torn. Each frame is stamped with
+   the time its last sample was captured (capture_time), to measure the
+   latency of what is computed from it, and numbered, so that a stage
+   which joins the frames (an STFT history) finds the gaps left by the
+   frames dropped (capture_contiguous).
+
+   Backends:
+     CAPTURE_I2S   : I2S built-in ADC mode, DMA (default)
+     CAPTURE_TIMER : hardware timer interrupt waking a task which reads
+                     the ADC (adc1_get_raw takes a lock: not in an ISR)
+     host (no ARDUINO) : replays a 16-bit PCM WAV file (capture_wav)
+                         at the capture rate, times a speed factor
+
+   Needs ring.h.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CAPTURE_I2S   0
+#define CAPTURE_TIMER 1
+#ifndef CAPTURE_BACKEND
+#define CAPTURE_BACKEND CAPTURE_I2S
+#endif
+#ifndef CAPTURE_CHANNEL
+#define CAPTURE_CHANNEL ADC1_CHANNEL_7 // GPIO 35 (microphone)
+#endif
+#ifndef CAPTURE_SLOTS
+#define CAPTURE_SLOTS 4   // frames in the ring (power of 2)
+#endif
+
+#ifdef ARDUINO
+#include <driver/adc.h>
+#include <driver/i2s.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#endif
+
+static frame_ring captureRing;
+static uint16_t* captureSlot = NULL;     // frame being filled, NULL if dropped
+static unsigned int captureSize = 0;     // samples per frame
+static unsigned int captureRate = 0;     // samples per second
+static unsigned int capturePos = 0;      // next sample in the frame being filled
+static volatile unsigned long captureFrames = 0;
+static volatile bool captureRunning = false;
+static unsigned long captureStamps[CAPTURE_SLOTS];  // capture_time of the slots
+static unsigned long captureIndexes[CAPTURE_SLOTS]; // numbers of the frames of the slots
+static unsigned long captureNext = 0;  // number of the frame after the last one checked
+
+// Microseconds, the clock of micros() (pipe_micros on the host)
+static inline unsigned long capture_micros()
+{
+#ifdef ARDUINO
+  return micros();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Slot of a frame of the ring
+static inline unsigned int capture_slot(const void* frame)
+{
+  return ((const uint8_t*) frame - captureRing.data) / captureRing.frameBytes;
+}
+
+// Stores a new sample (called by the backends)
+static inline void capture_push(uint16_t sample)
+{
+  if (capturePos == 0) captureSlot = (uint16_t*) ring_write_lease(&captureRing);
+  if (captureSlot != NULL) captureSlot[capturePos] = sample;
+  if (++capturePos < captureSize) return;
+  capturePos = 0;
+  if (captureSlot != NULL) {
+    const unsigned int slot = capture_slot(captureSlot);
+    captureStamps[slot] = capture_micros();
+    captureIndexes[slot] = captureFrames;
+    ring_write_commit(&captureRing);
+  } else ring_overrun(&captureRing); // ring full: frame dropped
+  ++captureFrames;
+}
+
+// Returns the oldest full frame not read yet, or NULL if none.
+// It must be given back with capture_release.
+const uint16_t* capture_frame()
+{
+  return (const uint16_t*) ring_read_lease(&captureRing);
+}
+
+// Time (capture_micros) at which the last sample of a frame of
+// capture_frame was captured
+unsigned long capture_time(const uint16_t* frame)
+{
+  return captureStamps[capture_slot(frame)];
+}
+
+// True if a frame of capture_frame directly follows the last frame
+// checked. False after frames dropped (ring full) or skipped: the
+// samples before the frame are not contiguous with it.
+bool capture_contiguous(const uint16_t* frame)
+{
+  const unsigned long index = captureIndexes[capture_slot(frame)];
+  const bool contiguous = (index == captureNext);
+  captureNext = index + 1;
+  return contiguous;
+}
+
+// Gives the frame back to the capture
+void capture_release()
+{
+  ring_read_release(&captureRing);
+}
+
+// Gives back all the frames waiting, for instance after a pause of the
+// analysis: the next frame is a new one
+void capture_skip()
+{
+  while (capture_frame() != NULL) capture_release();
+}
+
+// Frames captured since capture_begin, frames dropped and frames waiting
+unsigned long capture_frames() { return captureFrames; }
+unsigned long capture_overruns() { return ring_overruns(&captureRing); }
+unsigned int capture_depth() { return ring_depth(&captureRing); }
+
+static bool capture_alloc(unsigned int rate, unsigned int frameSize)
+{
+  ring_free(&captureRing);
+  if (!ring_init(&captureRing, CAPTURE_SLOTS, frameSize * sizeof(uint16_t))) return false;
+  captureSize = frameSize;
+  captureRate = rate;
+  capturePos = 0;
+  captureFrames = 0;
+  captureNext = 0;
+  return true;
+}
+
+#ifdef ARDUINO
+#if CAPTURE_BACKEND == CAPTURE_I2S
+// DMA chunks are copied into the frames by a task, blocked between chunks
+static void capture_i2s_task(void* param)
+{
+  uint16_t chunk[1 + 64];  // a sample left by the last read, then the chunk
+  size_t left = 0;
+  for (;;) {
+    size_t n = 0;
+    i2s_read(I2S_NUM_0, chunk + left, 64 * sizeof(uint16_t), &n, portMAX_DELAY);
+    size_t count = left + n / sizeof(uint16_t);
+    // The ADC mode delivers the samples swapped by pairs, channel in the 4
+    // upper bits: whole pairs only, an odd last sample waits for its pair
+    for (size_t i = 0; i + 1 < count; i += 2) {
+      capture_push(chunk[i + 1] & 0x0FFF);
+      capture_push(chunk[i] & 0x0FFF);
+    }
+    left = count & 1;
+    if (left) chunk[0] = chunk[count - 1];
+  }
+}
+#else
+static hw_timer_t* captureTimer = NULL;
+static TaskHandle_t captureTask = NULL;
+
+// Each tick of the timer notifies the task
+static void IRAM_ATTR capture_timer_isr()
+{
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(captureTask, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+// One sample per tick: the ticks missed while the task was late are read
+// at once, so that a frame keeps captureSize samples of captureRate
+static void capture_timer_task(void* param)
+{
+  for (;;) {
+    uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (ticks-- > 0) capture_push(adc1_get_raw(CAPTURE_CHANNEL));
+  }
+}
+#endif
+
+// Starts the capture of frames of frameSize samples, rate samples per second
+bool capture_begin(unsigned int rate, unsigned int frameSize)
+{
+  if (!capture_alloc(rate, frameSize)) return false;
+#if CAPTURE_BACKEND == CAPTURE_I2S
+  i2s_config_t config;
+  memset(&config, 0, sizeof(config));
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = rate;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+  config.dma_buf_count = 4;
+  config.dma_buf_len = 256;
+  if (i2s_driver_install(I2S_NUM_0, &config, 0, NULL) != ESP_OK) return false;
+  i2s_set_adc_mode(ADC_UNIT_1, CAPTURE_CHANNEL);
+  i2s_adc_enable(I2S_NUM_0);
+  xTaskCreatePinnedToCore(capture_i2s_task, "capture", 2048, NULL,
+                          configMAX_PRIORITIES - 1, NULL, 0);
+#else
+  xTaskCreatePinnedToCore(capture_timer_task, "capture", 2048, NULL,
+                          configMAX_PRIORITIES - 1, &captureTask, 0);
+  captureTimer = timerBegin(0, 80, true); // 1 MHz
+  timerAttachInterrupt(captureTimer, &capture_timer_isr, true);
+  timerAlarmWrite(captureTimer, 1000000ul / rate, true);
+  timerAlarmEnable(captureTimer);
+#endif
+  captureRunning = true;
+  return true;
+}
+
+#else
+/*
+   Host backend: WAV file replay
+*/
+static const char* captureWavPath = NULL;
+static float captureSpeed = 1.0f;
+static std::thread captureThread;
+
+// Chooses the WAV file replayed by capture_begin, and its replay speed
+// (1: real time at the capture rate, 2: twice faster, 0: no pacing)
+void capture_wav(const char* path, float speed)
+{
+  captureWavPath = path;
+  captureSpeed = speed;
+}
+
+// Reads a WAV header up to the data chunk. Returns the number of
+// channels (16-bit PCM only), 0 on error, and the data size in bytes.
+static int capture_wav_header(FILE* f, uint32_t* dataSize)
+{
+  char id[4];
+  uint32_t size;
+  uint16_t format = 0, channels = 0, bits = 0;
+  if (fread(id, 1, 4, f) != 4 || memcmp(id, "RIFF", 4)) return 0;
+  fseek(f, 4, SEEK_CUR);
+  if (fread(id, 1, 4, f) != 4 || memcmp(id, "WAVE", 4)) return 0;
+  while (fread(id, 1, 4, f) == 4 && fread(&size, 4, 1, f) == 1) {
+    if (!memcmp(id, "fmt ", 4)) {
+      if (fread(&format, 2, 1, f) != 1 || fread(&channels, 2, 1, f) != 1) return 0;
+      fseek(f, 10, SEEK_CUR);
+      if (fread(&bits, 2, 1, f) != 1) return 0;
+      fseek(f, size - 16, SEEK_CUR);
+    } else if (!memcmp(id, "data", 4)) {
+      *dataSize = size;
+      return (format == 1 && bits == 16) ? channels : 0;
+    } else fseek(f, size, SEEK_CUR);
+  }
+  return 0;
+}
+
+static void capture_wav_thread(FILE* f, int channels, uint32_t count)
+{
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  int16_t frame[8];
+  unsigned int n = 0;
+  while (captureRunning && count-- > 0
+         && fread(frame, sizeof(int16_t), channels, f) == (size_t) channels) {
+    // First channel, as a 12-bit ADC sample
+    capture_push((frame[0] >> 4) + 2048);
+    if (++n == captureSize) {
+      n = 0;
+      if (captureSpeed > 0) {
+        next += std::chrono::microseconds((long)(1e6 * captureSize / captureRate / captureSpeed));
+        std::this_thread::sleep_until(next);
+      }
+    }
+  }
+  fclose(f);
+  captureRunning = false;
+}
+
+bool capture_begin(unsigned int rate, unsigned int frameSize)
+{
+  if (captureWavPath == NULL || !capture_alloc(rate, frameSize)) return false;
+  FILE* f = fopen(captureWavPath, "rb");
+  if (f == NULL) return false;
+  uint32_t dataSize = 0;
+  int channels = capture_wav_header(f, &dataSize);
+  if (channels < 1 || channels > 8) {
+    fclose(f);
+    return false;
+  }
+  captureRunning = true;
+  captureThread = std::thread(capture_wav_thread, f, channels,
+                              dataSize / (channels * sizeof(int16_t)));
+  return true;
+}
+
+// Stops the replay
+void capture_end()
+{
+  captureRunning = false;
+  if (captureThread.joinable()) captureThread.join();
+}
+#endif
+
+// True while frames are being captured (false at the end of a WAV file)
+bool capture_running() { return captureRunning; }
+
+// Waits for a full frame. Returns NULL if the capture is over.
+const uint16_t* capture_wait()
+{
+  const uint16_t* frame;
+  while ((frame = capture_frame()) == NULL) {
+    if (!captureRunning) return NULL;
+#ifdef ARDUINO
+    delay(1);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+  }
+  return frame;
+}
@@ -0,0 +1,170 @@
+/*
+   Binary dataset of spectra, instead of the text /Data.txt
+
+   A 16 bytes header, then the rows:
+
+     offset  size
+          0     4  magic "SNDS"
+          4     2  version (1)
+          6     2  nips: features per row (the bands, then the amplitude)
+          8     4  rows
+         12     4  reserved
+         16        rows of nips uint16 features and a uint8 label
+                   (2 nips + 1 bytes each)
+
+   Everything is little endian. The writer (Record/Acquisition_ESP32)
+   keeps the file open while it appends rows, and writes the row count
+   once, when it closes it (dataset_end): the file is valid at any time,
+   the rows after the last count (e.g. on a reset) are ignored. The
+   reader reads the rows from flash when asked, a chunk of consecutive
+   rows when they are read in order, else the row only (shuffled
+   training): the dataset is not limited by the RAM and nothing is
+   parsed.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATASET_MAGIC 0x53444E53u  // "SNDS"
+#define DATASET_VERSION 1
+#define DATASET_HEADER 16
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t nips;
+  uint32_t rows;
+  uint32_t reserved;
+}
+dataset_header;
+
+typedef struct
+{
+  File file;
+  int nips;                // features per row
+  unsigned long rows;      // rows in the file
+  int rowBytes;            // 2 nips + 1
+  uint8_t *chunk;          // chunkRows rows
+  int chunkRows;
+  unsigned long first;     // first row in the chunk
+  int count;               // rows in the chunk, 0: empty
+}
+dataset_reader;
+
+typedef struct
+{
+  File file;               // open from dataset_begin to dataset_end
+  dataset_header h;        // rows: rows written
+  int rowBytes;            // 2 nips + 1
+}
+dataset_writer;
+
+// Creates an empty dataset of nips features per row
+bool dataset_create(const char *path, int nips)
+{
+  File file = SPIFFS.open(path, FILE_WRITE);
+  if (!file) return false;
+  dataset_header h = {DATASET_MAGIC, DATASET_VERSION, (uint16_t) nips, 0, 0};
+  bool ok = file.write((const uint8_t *) &h, sizeof(h)) == sizeof(h);
+  file.close();
+  return ok;
+}
+
+// Opens a dataset to append rows, after its counted rows
+bool dataset_begin(dataset_writer *w, const char *path)
+{
+  w->file = SPIFFS.open(path, "r+");
+  if (!w->file) return false;
+  if (w->file.read((uint8_t *) &w->h, sizeof(w->h)) != sizeof(w->h)
+      || w->h.magic != DATASET_MAGIC || w->h.version != DATASET_VERSION || w->h.nips == 0
+      || !w->file.seek(DATASET_HEADER + w->h.rows * (2 * w->h.nips + 1))) {
+    w->file.close();
+    return false;
+  }
+  w->rowBytes = 2 * w->h.nips + 1;
+  return true;
+}
+
+// Appends a row of features and its label, counted at dataset_end
+bool dataset_append(dataset_writer *w, const uint16_t *features, uint8_t label)
+{
+  if (!w->file) return false;
+  uint8_t row[w->rowBytes];
+  for (int i = 0; i < w->h.nips; i++) {
+    row[2 * i] = features[i] & 0xFF;
+    row[2 * i + 1] = features[i] >> 8;
+  }
+  row[2 * w->h.nips] = label;
+  if (w->file.write(row, w->rowBytes) != (size_t) w->rowBytes) return false;
+  ++w->h.rows;
+  return true;
+}
+
+// Writes the row count and closes the dataset
+bool dataset_end(dataset_writer *w)
+{
+  if (!w->file) return false;
+  bool ok = w->file.seek(0) && w->file.write((const uint8_t *) &w->h, sizeof(w->h)) == sizeof(w->h);
+  w->file.close();
+  return ok;
+}
+
+// Opens a dataset, with a chunk of chunkRows rows in RAM
+bool dataset_open(dataset_reader *r, const char *path, int chunkRows)
+{
+  r->file = SPIFFS.open(path, FILE_READ);
+  if (!r->file) return false;
+  dataset_header h;
+  if (r->file.read((uint8_t *) &h, sizeof(h)) != sizeof(h)
+      || h.magic != DATASET_MAGIC || h.version != DATASET_VERSION || h.nips == 0) {
+    r->file.close();
+    return false;
+  }
+  r->nips = h.nips;
+  r->rowBytes = 2 * h.nips + 1;
+  // Rows counted and complete
+  unsigned long inFile = (r->file.size() - DATASET_HEADER) / r->rowBytes;
+  r->rows = (h.rows < inFile) ? h.rows : inFile;
+  r->chunkRows = chunkRows;
+  r->chunk = (uint8_t *) malloc(chunkRows * r->rowBytes);
+  r->first = 0;
+  r->count = 0;
+  if (r->chunk == NULL) {
+    r->file.close();
+    return false;
+  }
+  return true;
+}
+
+// Row of the dataset, read from flash if not in RAM: with the next
+// rows if it follows the chunk (reading in order), else alone
+const uint8_t* dataset_row(dataset_reader *r, unsigned long row)
+{
+  if (row < r->first || row >= r->first + r->count) {
+    unsigned long n = 1;
+    if (row == r->first + r->count) {
+      n = r->rows - row;
+      if (n > (unsigned long) r->chunkRows) n = r->chunkRows;
+    }
+    r->first = row;
+    r->file.seek(DATASET_HEADER + r->first * r->rowBytes);
+    r->count = r->file.read(r->chunk, n * r->rowBytes) / r->rowBytes;
+  }
+  return r->chunk + (row - r->first) * r->rowBytes;
+}
+
+// Features of a row times scale into in, returns the label
+int dataset_get(dataset_reader *r, unsigned long row, float *in, float scale)
+{
+  const uint8_t *p = dataset_row(r, row);
+  for (int i = 0; i < r->nips; i++) in[i] = (p[2 * i] | (p[2 * i + 1] << 8)) * scale;
+  return p[2 * r->nips];
+}
+
+void dataset_close(dataset_reader *r)
+{
+  free(r->chunk);
+  r->chunk = NULL;
+  r->file.close();
+}
@@ -0,0 +1,199 @@
+/*
+   Fixed-point (Q15) version of the real FFT, for integer-only features
+
+   The 12-bit ADC samples are centred, scaled to Q15 and windowed with a
+   Q15 table (q15_table of a window_table) while they are loaded in their
+   bit-reversed slots (the same rfft_slots as the float path). The FFT is block floating point: the
+   values share one exponent, and before each radix-2 stage the block is
+   shifted right just enough to make the butterflies overflow-free.
+   Bin k of the float path is  data[k] * 2^exponent / 16.
+
+   Needs fft.h (tables and bit-reversed slots).
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#define Q15_ONE 32767
+#define Q15_HEADROOM 8192   // block peak allowed before a stage: (1 + √2) * 8192 < 2^15
+#define Q15_INPUT_SHIFT 4   // 12-bit samples -> Q15
+
+// Q15 twiddle tables, one per transform size
+static int16_t* q15_twiddles[FFT_MAX_LOG2 + 1] = {NULL};
+
+static int16_t q15_from_float(float x)
+{
+  float v = x * 32768.0f;
+  if (v >= Q15_ONE) return Q15_ONE;
+  if (v <= -32768.0f) return -32768;
+  return (int16_t) lroundf(v);
+}
+
+// Returns W^k for k < N/2 in Q15, built from the float table on first call
+const int16_t* q15_twiddle(unsigned int log2_N)
+{
+  if (log2_N < 2 || log2_N > FFT_MAX_LOG2) return NULL;
+  if (q15_twiddles[log2_N] == NULL) {
+    const float* tw = fft_twiddle(log2_N);
+    if (tw == NULL) return NULL;
+    unsigned int size = (log2_N < 1) ? 1 : 1 << (log2_N - 1);
+    int16_t* w = (int16_t*) malloc(2 * size * sizeof(int16_t));
+    if (w == NULL) return NULL;
+    for (unsigned int k = 0; k < size; k++) {
+      float wr, wi;
+      fft_w(tw, (1u << log2_N) / 4, k, &wr, &wi);
+      w[2 * k] = q15_from_float(wr);
+      w[2 * k + 1] = q15_from_float(wi);
+    }
+    q15_twiddles[log2_N] = w;
+  }
+  return q15_twiddles[log2_N];
+}
+
+// Returns a new Q15 copy of a table of n float coefficients (a window)
+int16_t* q15_table(const float* coef, unsigned int n)
+{
+  if (coef == NULL) return NULL;
+  int16_t* q = (int16_t*) malloc(n * sizeof(int16_t));
+  if (q == NULL) return NULL;
+  for (unsigned int i = 0; i < n; i++) q[i] = q15_from_float(coef[i]);
+  return q;
+}
+
+// Builds the tables used by rfft_q15_evaluate (call it in setup)
+bool rfft_q15_init(unsigned int log2_N)
+{
+  return rfft_init(log2_N) && q15_twiddle(log2_N) != NULL;
+}
+
+// Windowed Q15 value of a 12-bit sample, dc being the offset of the signal
+static inline int16_t q15_sample(int sample, int dc, int16_t coef)
+{
+  int32_t x = (sample - dc) * (1 << Q15_INPUT_SHIFT);
+  if (x > Q15_ONE) x = Q15_ONE;
+  else if (x < -32768) x = -32768;
+  return (x * coef) >> 15;
+}
+
+// Radix-2 block floating point butterflies on N bit-reversed complex
+// values (interleaved int16). peak is the largest |component| of the
+// input. Returns the number of right shifts applied to the block.
+static int fft_q15_butterflies(int16_t* A, unsigned int log2_N, int peak,
+                               const int16_t* tw, unsigned int twShift)
+{
+  unsigned int N = 1 << log2_N;
+  int exponent = 0;
+  for (unsigned int h = 1; h < N; h <<= 1) {
+    int s = 0;
+    while ((peak >> s) >= Q15_HEADROOM) s++;
+    exponent += s;
+    int32_t newPeak = 0;
+    unsigned int stride = (N / (2 * h)) << twShift;   /* W^k = tw[k * stride] */
+    for (unsigned int k = 0; k < h; k++) {
+      const int32_t wr = tw[2 * k * stride], wi = tw[2 * k * stride + 1];
+      for (unsigned int n = k; n < N; n += 2 * h) {
+        int16_t* a = A + 2 * n;
+        int16_t* b = a + 2 * h;
+        int32_t tr = (wr * b[0] - wi * b[1]) >> 15;
+        int32_t ti = (wr * b[1] + wi * b[0]) >> 15;
+        int32_t y0 = (a[0] + tr) >> s, y1 = (a[1] + ti) >> s;
+        int32_t y2 = (a[0] - tr) >> s, y3 = (a[1] - ti) >> s;
+        a[0] = y0; a[1] = y1; b[0] = y2; b[1] = y3;
+        int32_t m = max(max(abs(y0), abs(y1)), max(abs(y2), abs(y3)));
+        if (m > newPeak) newPeak = m;
+      }
+    }
+    peak = newPeak;
+  }
+  return exponent;
+}
+
+int rfft_q15_evaluate(int16_t* data, unsigned int log2_N, int peak)
+{
+  /*
+     Forward FFT of N real Q15 values loaded in bit-reversed order
+     (data[rfft_slots(log2_N)[i]] = sample i), see rfft_evaluate_f.
+
+     output:
+         data[] = bins X[0] ... X[N/2 - 1] as interleaved int16 pairs,
+         the real Nyquist bin in the imaginary part of X[0]
+     returns:
+         the block exponent: bin of the float path = data * 2^exponent / 16
+         (q15_unscale)
+
+     The split step works in 32 bits and halves its results, which
+     keeps them in 16 bits: the exponent takes one more step.
+  */
+
+  if (log2_N < 2) return 0;
+  const int16_t* tw = q15_twiddle(log2_N);
+  if (tw == NULL) return 0;
+  unsigned int M = 1 << (log2_N - 1);
+  int exponent = fft_q15_butterflies(data, log2_N - 1, peak, tw, 1) + 1;
+
+  // Split step (see rfft_evaluate_f), results / 2
+  int32_t z0 = data[0];
+  int32_t z1 = data[1];
+  data[0] = (z0 + z1) >> 1;   // DC
+  data[1] = (z0 - z1) >> 1;   // Nyquist
+  for (unsigned int k = 1; k <= M / 2; k++) {
+    int16_t* a = data + 2 * k;
+    int16_t* b = data + 2 * (M - k);
+    int32_t er = a[0] + b[0], ei = a[1] - b[1];        // 2 E[k]
+    int32_t odr = a[1] + b[1], odi = b[0] - a[0];      // 2 O[k]
+    int32_t wr = tw[2 * k], wi = tw[2 * k + 1];
+    int32_t tr = (wr * odr - wi * odi) >> 15;
+    int32_t ti = (wr * odi + wi * odr) >> 15;
+    a[0] = (er + tr) >> 2;  a[1] = (ei + ti) >> 2;
+    b[0] = (er - tr) >> 2;  b[1] = (ti - ei) >> 2;
+  }
+  return exponent;
+}
+
+// Value of a Q15 bin component in the units of the float path
+static inline int32_t q15_unscale(int32_t v, int exponent)
+{
+  int shift = exponent - Q15_INPUT_SHIFT;
+  return (shift >= 0) ? v * (1 << shift) : v >> -shift;
+}
+
+// Integer magnitude |X| ~ max(max, 7/8 max + 1/2 min)
+// (alpha max plus beta min, less than 3% error)
+static inline int32_t q15_magnitude(int32_t re, int32_t im)
+{
+  re = abs(re);
+  im = abs(im);
+  int32_t mx = (re > im) ? re : im;
+  int32_t mn = (re > im) ? im : re;
+  int32_t m = mx - (mx >> 3) + (mn >> 1);
+  return (m > mx) ? m : mx;
+}
+
+/*
+   Quantization of the features to int8, for an int8 TFLite input tensor
+   (scale and zero point of the tensor) or an int8 classifier: the
+   integer feature value, which the float path divides by att, is mapped
+   to value / (att * scale) + zero point, computed as an integer product
+   with a 16-bit fractional multiplier.
+*/
+typedef struct
+{
+  int32_t mult;   // 2^16 / (att * scale)
+  int32_t zero;   // zero point
+}
+q15_quant;
+
+q15_quant q15_quant_init(float scale, int zeroPoint, float att)
+{
+  q15_quant q;
+  q.mult = lroundf(65536.0f / (att * scale));
+  q.zero = zeroPoint;
+  return q;
+}
+
+static inline int8_t q15_quantize(int32_t value, q15_quant q)
+{
+  int32_t v = (int32_t)(((int64_t) value * q.mult + 32768) >> 16) + q.zero;
+  if (v > 127) v = 127;
+  else if (v < -128) v = -128;
+  return v;
+}
@@ -1,58 +1,43 @@
-#define SWAP(x, y) do { typeof(x) SWAP = x; x = y; y = SWAP; } while (0)
-
-// Data object.
+// View of a dataset: the rows index[0] ... index[rows - 1] of an input
+// and a target array, without copy. Row r of the inputs starts at
+// in + r * inStride, its target at tg + r * tgStride.
 typedef struct
 {
-  // 2D floating point array of input.
-  float** in;
-  // 2D floating point array of target.
-  float** tg;
-  // Number of inputs to neural network.
-  int nips;
-  // Number of outputs to neural network.
-  int nops;
-  // Number of rows in file (number of sets for neural network).
+  const float* in;
+  int inStride;
+  const float* tg;
+  int tgStride;
+  int* index;
   int rows;
 }
-Data;
+DataView;
 
-// New 2D array of floats.
-static float** new2d(const int rows, const int cols)
+static inline const float* viewIn(const DataView& v, const int i)
 {
-  float** row = (float**) malloc((rows) * sizeof(float*));
-  for (int r = 0; r < rows; r++)
-    row[r] = (float*) malloc((cols) * sizeof(float));
-  return row;
+  return v.in + v.index[i] * v.inStride;
 }
 
-// New data object.
-static Data ndata(const int nips, const int nops, const int rows)
+static inline const float* viewTg(const DataView& v, const int i)
 {
-  const Data data = {
-    new2d(rows, nips), new2d(rows, nops), nips, nops, rows
-  };
-  return data;
+  return v.tg + v.index[i] * v.tgStride;
 }
 
-// Randomly shuffles a data object.
-static void shuffle(const Data d, int nBatch, int nTrain)
+// Seed of a shuffle: SEED + stream, or random if SEED is 0
+static uint64_t shuffleSeed(int stream)
 {
-  //  for (int a = 0; a < d.rows; a++)
-  for (int a = 0; a < nBatch; a++)
-  {
-    //    const int b = esp_random() % d.rows;
-    const int b = esp_random() % nTrain;
-    float* ot = d.tg[a];
-    float* it = d.in[a];
-    // Swap output.
-    d.tg[a] = d.tg[b];
-    d.tg[b] = ot;
-    // Swap input.
-    d.in[a] = d.in[b];
-    d.in[b] = it;
-  }
+  if (SEED != 0) return (uint64_t) SEED + stream;
+  return ((uint64_t) esp_random() << 32) | esp_random();
 }
 
+// Shuffled order of the rows of the dataset: the training set is its
+// beginning, the testing set its end
+int* datasetOrder = NULL;
+int datasetRows = 0;
+#if DATASET_BIN
+// Binary dataset, streamed from flash
+dataset_reader dataset;
+#endif
+
 // Display "file read" and shuffle dataset
 void finish (int iRow, int bands, int disp) {
   if (disp == 1) {
@@ -68,13 +53,14 @@ void finish (int iRow, int bands, int disp) {
     display.display();
     delay(1500);
   }
-  // Shuffling dataset
-  for (int i = 0; i < 3 * iRow; i++) {
-    int ind1 = random(iRow);
-    int ind2 = random(iRow);
-    for (int j = 0; j < bands + 1; j++) SWAP(input[ind1][j], input[ind2][j]);
-    SWAP(output[ind1], output[ind2]);
-  }
+  // Shuffling dataset (its order)
+  datasetRows = iRow;
+  free(datasetOrder);
+  datasetOrder = (int*) malloc(iRow * sizeof(int));
+  for (int i = 0; i < iRow; i++) datasetOrder[i] = i;
+  xoshiro128 rng;
+  xoshiro_seed(&rng, shuffleSeed(0));
+  permute(datasetOrder, iRow, &rng);
 }
 
 int init (const char * path, byte disp) {
@@ -98,6 +84,17 @@ int init (const char * path, byte disp) {
     display.display();
     while (1);
   }
+#if DATASET_BIN
+  if (dataset.chunk != NULL) dataset_close(&dataset);
+  if (!dataset_open(&dataset, path, DATASET_CHUNK)) {
+    Serial.println("Abort: bad dataset file");
+    while (1);
+  }
+  bands = dataset.nips - 1;
+  if (disp == 1) Serial.print("Reading dataset: ");
+  finish (dataset.rows, bands, disp);
+  return dataset.rows;
+#else
   // Read dataset file
   File file = SPIFFS.open(path, FILE_READ);
   // Read number of frequency bands
@@ -162,4 +159,39 @@ int init (const char * path, byte disp) {
   }
   finish (iRow, bands, disp);
   return iRow;
+#endif
+}
+
+// Sample i of the shuffled dataset: in place in input and output (text
+// dataset), or read from flash into inBuf (bands + 1 values) and tgBuf
+void getSample (int i, const float*& in, const float*& tg, float* inBuf, float* tgBuf) {
+#if DATASET_BIN
+  tgBuf[0] = dataset_get(&dataset, datasetOrder[i], inBuf, 1.0f / ATT);
+  in = inBuf;
+  tg = tgBuf;
+#else
+  in = input[datasetOrder[i]];
+  tg = &output[datasetOrder[i]];
+#endif
+}
+
+// Largest value of each of the nips inputs over the rows of the dataset
+void datasetRange (int nips, float *top) {
+  float inBuf[nips], tgBuf[1];
+  for (int i = 0; i < nips; i++) top[i] = 0;
+  for (int sample = 0; sample < datasetRows; sample++) {
+    const float *in, *tg;
+    getSample(sample, in, tg, inBuf, tgBuf);
+    for (int i = 0; i < nips; i++)
+      if (in[i] > top[i]) top[i] = in[i];
+  }
+}
+
+// Label (0 or 1) of sample i of the shuffled dataset
+int getLabel (int i) {
+#if DATASET_BIN
+  return dataset_row(&dataset, datasetOrder[i])[2 * dataset.nips] != 0;
+#else
+  return output[datasetOrder[i]] > 0.5f;
+#endif
 }
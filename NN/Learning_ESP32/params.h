@@ -5,16 +5,36 @@
 // FFT parameters
 #define SAMPLES 256
 #define MAX_FREQ 20 // kHz
+#define HOP 128     // STFT hop in samples (SAMPLES: no overlap)
+#define STFT_COLUMNS 32  // frames kept in the spectrogram
 // Attenuation and threshold for display
 #define COEF 40
+#define DISPLAY_PERIOD 50ul  // ms between two spectrum displays
 #define ATT 500.0f
+// Features from the float FFT (0), or the fixed-point Q15 FFT and the
+// int8 network (1, TinnQ8.h)
+#define FIXED_POINT 0
+// int8 features (FIXED_POINT): range of each one, times its largest
+// value in the dataset
+#define Q8_HEADROOM 1.5f
+// Sequential loop (0) or task pipeline on both cores (1)
+#define PIPELINE 0
 
 //
 #define RATIO 0.8f         // ratio of training data vs. testing
 #define EPOCHS 6000        // number of training epochs
 #define NHID 40            // number of hidden layers
+#define DENSE 0            // Tinn (0) or dense network with several hidden layers (1)
+#define DENSE_HIDDEN {NHID, 16}  // hidden layer sizes of the dense network (LR 0.3)
+#define DATASET_BIN 0      // dataset read from text /Data.txt (0) or streamed from binary /Data.bin (1)
+#define DATASET_CHUNK 16   // rows of the binary dataset read at once, when read in order
+#define NETWORK_BIN 0      // Tinn saved as text /Network.txt (0) or binary /Network.bin (1)
+//#define NETWORK_PARTITION "network" // flash partition of the binary network, used in place
 #define ACTIVATION RELU // chosen activation function of hidden layer
 #define BATCH 50           // number of data used for training in each epoch
+#define BATCHED 0          // one weight update per batch (1) or per sample (0)
+#define STRATIFIED 0       // batches of random rows (0) or as many snore as silence rows (1)
+#define SEED 0             // seed of the shuffles (reproducible runs), 0: random
 #define LR 1.0f            // initial learning rate
 #define ANNEAL 0.9999f     // rate of change of learning rate
 #define MAXERR 0.0005f     // stop training if error is less than this
@@ -0,0 +1,241 @@
+/*
+   Task pipeline
+
+   A pipeline is an array of stages. Each stage is a task (std::thread on
+   the host) pinned to a core, which takes an item from its input queue,
+   processes it and passes it on to its output queue. The queues are
+   bounded frame rings (ring.h), and a stage waits while its output queue
+   is full (back pressure up to the capture, which drops frames when its
+   own ring is full).
+
+   The items are not copied between the stages: they live in a pool
+   (pipe_pool) and the queues carry their pointers. The first stage takes
+   a free item from the pool and fills it, the next ones work on it in
+   place and pass the pointer on (pipe_item, pipe_pass), the last one
+   gives it back to the pool. The first stage reads its input, a frame
+   of the capture ring, in place as well.
+
+   Each stage measures the time spent per item (mean and max) and the
+   largest depth seen in its input queue (pipe_report). The end-to-end
+   latency, from the capture of a frame (capture_time) to the output of
+   its result, is measured by the output stage (pipe_latency_add), the
+   time of capture being carried by the items.
+
+   Needs ring.h.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#endif
+
+#define PIPE_MAX_STAGES 8
+
+// Processes the item in into the item out (NULL for the last stage).
+// Returns false to drop the item.
+typedef bool (*pipe_fn)(const void *in, void *out);
+
+// Statistics of a stage
+typedef struct
+{
+  volatile unsigned long items;   // items processed
+  volatile unsigned long maxUs;   // longest processing time
+  volatile uint64_t totalUs;      // total processing time
+  volatile unsigned int maxDepth; // largest input queue depth seen
+}
+pipe_stats;
+
+typedef struct
+{
+  const char *name;
+  pipe_fn fn;
+  frame_ring *in;                 // input queue
+  frame_ring *out;                // output queue, NULL for the last stage
+  int core;                       // core of the task (ESP32)
+  pipe_stats stats;               // zero ({}) at the start
+}
+pipe_stage;
+
+// Pool of the items passed by pointer between the stages: the free
+// items are in a ring of pointers, taken by the first stage and given
+// back by the last one (one producer, one consumer)
+typedef struct
+{
+  uint8_t *items;
+  frame_ring free;
+}
+pipe_pool;
+
+// End-to-end latency of the items
+typedef struct
+{
+  volatile unsigned long items;
+  volatile unsigned long maxUs;
+  volatile uint64_t totalUs;
+}
+pipe_latency;
+
+static volatile bool pipeRunning = false;
+#ifndef ARDUINO
+static std::thread pipeThreads[PIPE_MAX_STAGES];
+static int pipeThreadCount = 0;
+#endif
+
+static inline unsigned long pipe_micros()
+{
+#ifdef ARDUINO
+  return micros();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Lets the other tasks run while a queue is empty or full
+static inline void pipe_idle()
+{
+#ifdef ARDUINO
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+// Last stage: gives an item back to the pool
+void pipe_pool_give(pipe_pool *p, void *item)
+{
+  void **slot = (void **) ring_write_lease(&p->free);
+  if (slot == NULL) return;  // not an item of the pool: the ring holds them all
+  *slot = item;
+  ring_write_commit(&p->free);
+}
+
+// First stage: a free item of the pool, or NULL if all are in use
+void *pipe_pool_take(pipe_pool *p)
+{
+  void *const *slot = (void *const *) ring_read_lease(&p->free);
+  if (slot == NULL) return NULL;
+  void *item = *slot;
+  ring_read_release(&p->free);
+  return item;
+}
+
+// Allocates a pool of count (power of 2) free items of itemBytes bytes.
+// Enough items for the slots of all the queues, and one held by the
+// first stage, are never missing.
+bool pipe_pool_init(pipe_pool *p, unsigned int count, unsigned int itemBytes)
+{
+  p->items = (uint8_t *) calloc(count, itemBytes);
+  if (p->items == NULL || !ring_init(&p->free, count, sizeof(void *))) {
+    free(p->items);
+    p->items = NULL;
+    return false;
+  }
+  for (unsigned int i = 0; i < count; i++) pipe_pool_give(p, p->items + i * itemBytes);
+  return true;
+}
+
+// Item whose pointer is in a slot of a queue (stage input)
+static inline void *pipe_item(const void *slot)
+{
+  return *(void *const *) slot;
+}
+
+// Passes an item on: its pointer into a slot of a queue (stage output)
+static inline void pipe_pass(void *slot, void *item)
+{
+  *(void **) slot = item;
+}
+
+static void pipe_run(pipe_stage *s)
+{
+  while (pipeRunning) {
+    const void *in = ring_read_lease(s->in);
+    if (in == NULL) {
+      pipe_idle();
+      continue;
+    }
+    unsigned int depth = ring_depth(s->in);
+    if (depth > s->stats.maxDepth) s->stats.maxDepth = depth;
+    void *out = NULL;
+    if (s->out != NULL)
+      while ((out = ring_write_lease(s->out)) == NULL && pipeRunning) pipe_idle();
+    if (!pipeRunning) break;
+    unsigned long t0 = pipe_micros();
+    bool keep = s->fn(in, out);
+    unsigned long dt = pipe_micros() - t0;
+    if (out != NULL && keep) ring_write_commit(s->out);
+    ring_read_release(s->in);
+    s->stats.totalUs += dt;
+    if (dt > s->stats.maxUs) s->stats.maxUs = dt;
+    ++s->stats.items;
+  }
+}
+
+#ifdef ARDUINO
+static void pipe_task(void *param)
+{
+  pipe_run((pipe_stage *) param);
+  vTaskDelete(NULL);
+}
+#endif
+
+// Starts one task per stage
+bool pipe_start(pipe_stage *stages, int n)
+{
+  if (n > PIPE_MAX_STAGES) return false;
+  pipeRunning = true;
+  for (int i = 0; i < n; i++) {
+    pipe_stats *st = &stages[i].stats;
+    st->items = st->maxUs = st->totalUs = st->maxDepth = 0;
+#ifdef ARDUINO
+    if (xTaskCreatePinnedToCore(pipe_task, stages[i].name, 8192, &stages[i], 1,
+                                NULL, stages[i].core) != pdPASS) return false;
+#else
+    pipeThreads[pipeThreadCount++] = std::thread(pipe_run, &stages[i]);
+#endif
+  }
+  return true;
+}
+
+#ifndef ARDUINO
+// Waits until every queue is empty, then stops the stages
+void pipe_stop(pipe_stage *stages, int n)
+{
+  for (int i = 0; i < n; i++)
+    while (ring_depth(stages[i].in) > 0) pipe_idle();
+  pipeRunning = false;
+  for (int i = 0; i < pipeThreadCount; i++) pipeThreads[i].join();
+  pipeThreadCount = 0;
+}
+#endif
+
+// Counts the output of an item whose frame was captured at capturedUs
+// (same clock as pipe_micros)
+void pipe_latency_add(pipe_latency *l, unsigned long capturedUs)
+{
+  unsigned long dt = pipe_micros() - capturedUs;
+  l->totalUs += dt;
+  if (dt > l->maxUs) l->maxUs = dt;
+  ++l->items;
+}
+
+// Prints the statistics of the stages
+void pipe_report(pipe_stage *stages, int n)
+{
+  printf("Stage       items  mean us  max us  max queue\n");
+  for (int i = 0; i < n; i++) {
+    pipe_stage *s = &stages[i];
+    unsigned long mean = s->stats.items ? (unsigned long)(s->stats.totalUs / s->stats.items) : 0;
+    printf("%-10s %6lu %8lu %7lu %6u/%u\n", s->name, s->stats.items, mean, s->stats.maxUs,
+           s->stats.maxDepth, s->in->mask + 1);
+  }
+}
+
+// Prints the end-to-end latency, under the statistics of the stages
+void pipe_latency_report(const pipe_latency *l)
+{
+  unsigned long mean = l->items ? (unsigned long)(l->totalUs / l->items) : 0;
+  printf("%-10s %6lu %8lu %7lu\n", "end to end", l->items, mean, l->maxUs);
+}
@@ -0,0 +1,146 @@
+/*
+   Epoch sampler for the training batches
+
+   The items (positions 0 ... n - 1 of the training set) are visited in
+   a random order, a new Fisher-Yates permutation at each epoch: every
+   item is used once per epoch, a batch never holds the same item twice
+   (unless it is larger than the training set).
+
+   Stratified (labels given to sampler_init): the items are grouped by
+   label, each label has its own permutation, and each batch takes the
+   same number of items of each label (snore / silence balanced batches,
+   whatever the proportions of the dataset).
+
+   The random numbers come from xoshiro128** (32 bits, fast on the
+   ESP32), seeded with splitmix64: the same seed gives the same
+   permutations and batches, on the ESP32 and on the host.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SAMPLER_CLASSES 2  // labels 0 and 1
+
+typedef struct
+{
+  uint32_t s[4];
+}
+xoshiro128;
+
+static inline uint32_t rotl32(const uint32_t x, int k)
+{
+  return (x << k) | (x >> (32 - k));
+}
+
+uint32_t xoshiro_next(xoshiro128 *r)
+{
+  const uint32_t result = rotl32(r->s[1] * 5, 7) * 9;
+  const uint32_t t = r->s[1] << 9;
+  r->s[2] ^= r->s[0];
+  r->s[3] ^= r->s[1];
+  r->s[1] ^= r->s[2];
+  r->s[0] ^= r->s[3];
+  r->s[2] ^= t;
+  r->s[3] = rotl32(r->s[3], 11);
+  return result;
+}
+
+void xoshiro_seed(xoshiro128 *r, uint64_t seed)
+{
+  // splitmix64, never gives an all zero state
+  for (int i = 0; i < 4; i += 2) {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    r->s[i] = (uint32_t) z;
+    r->s[i + 1] = (uint32_t) (z >> 32);
+  }
+}
+
+// Uniform integer in 0 ... n - 1, without the bias of a modulo
+uint32_t xoshiro_below(xoshiro128 *r, uint32_t n)
+{
+  uint64_t m = (uint64_t) xoshiro_next(r) * n;
+  if ((uint32_t) m < n) {
+    const uint32_t threshold = (0u - n) % n;
+    while ((uint32_t) m < threshold) m = (uint64_t) xoshiro_next(r) * n;
+  }
+  return m >> 32;
+}
+
+// Fisher-Yates shuffle of n ints
+void permute(int *a, int n, xoshiro128 *r)
+{
+  for (int i = n - 1; i > 0; i--) {
+    const int j = xoshiro_below(r, i + 1);
+    const int t = a[i];
+    a[i] = a[j];
+    a[j] = t;
+  }
+}
+
+typedef struct
+{
+  xoshiro128 rng;
+  int *items;                         // items, grouped by label if stratified
+  int classes;                        // 1, or SAMPLER_CLASSES if stratified
+  int start[SAMPLER_CLASSES + 1];     // items of class c: start[c] ... start[c + 1] - 1
+  int pos[SAMPLER_CLASSES];           // next item of class c in its epoch
+  unsigned long epochs;               // permutations of the class 0
+}
+sampler;
+
+// Sampler of n items. labels: label of each item (0 ... SAMPLER_CLASSES
+// - 1) for stratified batches, or NULL.
+bool sampler_init(sampler *s, int n, const uint8_t *labels, uint64_t seed)
+{
+  xoshiro_seed(&s->rng, seed);
+  s->items = (int *) malloc(n * sizeof(int));
+  if (s->items == NULL) return false;
+  s->classes = (labels != NULL) ? SAMPLER_CLASSES : 1;
+  int count[SAMPLER_CLASSES] = {0};
+  for (int i = 0; i < n; i++) ++count[(labels != NULL) ? labels[i] : 0];
+  s->start[0] = 0;
+  for (int c = 0; c < s->classes; c++) s->start[c + 1] = s->start[c] + count[c];
+  int next[SAMPLER_CLASSES];
+  for (int c = 0; c < s->classes; c++) next[c] = s->start[c];
+  for (int i = 0; i < n; i++) s->items[next[(labels != NULL) ? labels[i] : 0]++] = i;
+  for (int c = 0; c < s->classes; c++) {
+    if (count[c] == 0) s->classes = 1;  // a single label: not stratified
+    s->pos[c] = s->start[c + 1];        // permuted at the first batch
+  }
+  if (s->classes == 1) {
+    s->start[1] = n;
+    s->pos[0] = n;
+  }
+  s->epochs = 0;
+  return true;
+}
+
+// Next item of class c, starting a new epoch of the class if needed
+static int sampler_next(sampler *s, int c)
+{
+  if (s->pos[c] == s->start[c + 1]) {
+    permute(s->items + s->start[c], s->start[c + 1] - s->start[c], &s->rng);
+    s->pos[c] = s->start[c];
+    if (c == 0) ++s->epochs;
+  }
+  return s->items[s->pos[c]++];
+}
+
+// Fills out with the nBatch items of the next batch
+void sampler_batch(sampler *s, int *out, int nBatch)
+{
+  // Stratified: the classes in turn, from a random class
+  int c = (s->classes > 1) ? xoshiro_below(&s->rng, s->classes) : 0;
+  for (int j = 0; j < nBatch; j++) {
+    out[j] = sampler_next(s, c);
+    if (++c == s->classes) c = 0;
+  }
+}
+
+void sampler_free(sampler *s)
+{
+  free(s->items);
+  s->items = NULL;
+}
@@ -9,52 +9,54 @@
 #define BLACKMAN_HARRIS 0x07 /* blackman harris*/
 #define FLT_TOP 0x08 /* flat top */
 #define WELCH 0x09 /* welch */
+#define WINDOW_TYPES 10 /* number of window types */
 
-typedef enum fft_dir {
-  FFT_FORWARD,    /* kernel uses "-1" sign */
-  FFT_INVERSE     /* kernel uses "+1" sign */
-} fft_dir;
+// Weighting factor of sample i in a window of N samples
+double window_coef (unsigned int i, unsigned int N, byte windowType) {
+  if (i >= N / 2) i = N - (i + 1); // the windows are symmetric
+  double indexMinusOne = double(i);
+  double ratio = (indexMinusOne / (N - 1));
+  double weighingFactor = 1.0;
+  switch (windowType) {
+    case RECTANGLE: // rectangle (box car)
+      weighingFactor = 1.0;
+      break;
+    case HAMMING: // hamming
+      weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
+      break;
+    case HANN: // hann
+      weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
+      break;
+    case TRIANGLE: // triangle (Bartlett)
+      weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
+      break;
+    case NUTTALL: // nuttall
+      weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN: // blackman
+      weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
+      break;
+    case BLACKMAN_NUTTALL: // blackman nuttall
+      weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN_HARRIS: // blackman harris
+      weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
+      break;
+    case FLT_TOP: // flat top
+      weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
+      break;
+    case WELCH: // welch
+      weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
+      break;
+  }
+  return weighingFactor;
+}
 
 void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir direction) {
   unsigned int N = 1 << log2_N;
   unsigned int Nd2 = N >> 1;
   for (int i = 0; i < Nd2; i++) {
-    double indexMinusOne = double(i);
-    double ratio = (indexMinusOne / (N - 1));
-    double weighingFactor = 1.0;
-    // Compute and record weighting factor
-    switch (windowType) {
-      case RECTANGLE: // rectangle (box car)
-        weighingFactor = 1.0;
-        break;
-      case HAMMING: // hamming
-        weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
-        break;
-      case HANN: // hann
-        weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
-        break;
-      case TRIANGLE: // triangle (Bartlett)
-        weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
-        break;
-      case NUTTALL: // nuttall
-        weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN: // blackman
-        weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
-        break;
-      case BLACKMAN_NUTTALL: // blackman nuttall
-        weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN_HARRIS: // blackman harris
-        weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
-        break;
-      case FLT_TOP: // flat top
-        weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
-        break;
-      case WELCH: // welch
-        weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
-        break;
-    }
+    double weighingFactor = window_coef(i, N, windowType);
     if (direction == FFT_FORWARD) {
       data[i] *= weighingFactor;
       data[N - (i + 1)] *= weighingFactor;
@@ -66,210 +68,287 @@ void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir
   }
 }
 
-void ffti_shuffle_f(float complex *data, unsigned int log2_N)
-{
-  /*
-     Basic Bit-Reversal Scheme:
-
-     The incrementing pattern operations used here correspond
-     to the logic operations of a synchronous counter.
-
-     Incrementing a binary number simply flips a sequence of
-     least-significant bits, for example from 0111 to 1000.
-     So in order to compute the next bit-reversed index, we
-     have to flip a sequence of most-significant bits.
-  */
-
-  unsigned int N = 1 << log2_N;   /* N */
-  unsigned int Nd2 = N >> 1;      /* N/2 = number range midpoint */
-  unsigned int Nm1 = N - 1;       /* N-1 = digit mask */
-  unsigned int i;                 /* index for array elements */
-  unsigned int j;                 /* index for next element swap location */
-
-  for (i = 0, j = 0; i < N; i++) {
-    if (j > i) {
-      float complex tmp = data[i];
-      data[i] = data[j];
-      data[j] = tmp;
+// Same for N real samples
+void window (float *data, unsigned int log2_N, byte windowType, fft_dir direction) {
+  unsigned int N = 1 << log2_N;
+  unsigned int Nd2 = N >> 1;
+  for (int i = 0; i < Nd2; i++) {
+    float weighingFactor = window_coef(i, N, windowType);
+    if (direction == FFT_FORWARD) {
+      data[i] *= weighingFactor;
+      data[N - (i + 1)] *= weighingFactor;
     }
+    else {
+      data[i] /= weighingFactor;
+      data[N - (i + 1)] /= weighingFactor;
+    }
+  }
+}
 
-    /*
-       Find least significant zero bit
-    */
-
-    unsigned int lszb = ~i & (i + 1);
-
-    /*
-       Use division to bit-reverse the single bit so that we now have
-       the most significant zero bit
-
-       N = 2^r = 2^(m+1)
-       Nd2 = N/2 = 2^m
-       if lszb = 2^k, where k is within the range of 0...m, then
-           mszb = Nd2 / lszb
-                = 2^m / 2^k
-                = 2^(m-k)
-                = bit-reversed value of lszb
-    */
-
-    unsigned int mszb = Nd2 / lszb;
-
-    /*
-       Toggle bits with bit-reverse mask
-    */
+// Window coefficient tables, one per (window type, size), built on first use
+static float* windowTables[WINDOW_TYPES][FFT_MAX_LOG2 + 1] = {{NULL}};
 
-    unsigned int bits = Nm1 & ~(mszb - 1);
-    j ^= bits;
+// Returns the N = 2^log2_N coefficients of a window (the reference
+// window() above computes the same values at each call)
+const float* window_table (byte windowType, unsigned int log2_N) {
+  if (windowType >= WINDOW_TYPES || log2_N > FFT_MAX_LOG2) return NULL;
+  if (windowTables[windowType][log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;
+    float* table = (float*) malloc(N * sizeof(float));
+    if (table == NULL) return NULL;
+    for (unsigned int i = 0; i < N; i++) table[i] = window_coef(i, N, windowType);
+    windowTables[windowType][log2_N] = table;
   }
+  return windowTables[windowType][log2_N];
 }
 
+// Windows N real samples with the cached coefficients
+void window_apply (float *data, unsigned int log2_N, byte windowType) {
+  const float* coef = window_table(windowType, log2_N);
+  if (coef == NULL) return;
+  unsigned int N = 1 << log2_N;
+  for (unsigned int i = 0; i < N; i++) data[i] *= coef[i];
+}
 
+#if FIXED_POINT
+// The bins of the float FFT hold the spectrum of the offset of the
+// signal through the window, which leaks into the low bands of the
+// features the network was trained on. The fixed-point FFT does not
+// have it (the offset is removed before, to keep its range for the
+// sound): it is added back to the real parts, offset x real part of the DFT of the
+// window (Q16, int64 products). The table is built by windowLeakInit
+// in setup().
+static int32_t *windowLeak = NULL;
 
-void ffti_evaluate_f(float complex *data, unsigned int log2_N, fft_dir direction)
-{
-  /*
-     In-place FFT butterfly algorithm
-
-     input:
-         A[] = array of N shuffled complex values where N is a power of 2
-     output:
-         A[] = the DFT of input A[]
+// Builds the table of the offset leak. Returns false if the memory is
+// missing: then no leak is added.
+bool windowLeakInit () {
+  if (windowLeak != NULL) return true;
+  const float *coef = window_table(HAMMING, LOG2SAMPLE);
+  int32_t *leak = (int32_t *) malloc(SAMPLES / 2 * sizeof(int32_t));
+  if (coef == NULL || leak == NULL) {
+    free(leak);
+    return false;
+  }
+  for (int k = 0; k < SAMPLES / 2; k++) {
+    double re = 0;
+    for (int n = 0; n < SAMPLES; n++) re += coef[n] * cos(2 * PI * k * n / SAMPLES);
+    leak[k] = lround(re * 65536);
+  }
+  windowLeak = leak;
+  return true;
+}
 
-     for r = 1 to log2(N)
-         m = 2^r
-         Wm = exp(−j2π/m)
-         for n = 0 to N-1 by m
-             Wmk = 1
-             for k = 0 to m/2 - 1
-                 u = A[n + k]
-                 t = Wmk * A[n + k + m/2]
-                 A[n + k]       = u + t
-                 A[n + k + m/2] = u - t
-                 Wmk = Wmk * Wm
+static inline int32_t offsetLeak (int offset, int i) {
+  if (windowLeak == NULL) return 0;
+  return (int32_t)(((int64_t) offset * windowLeak[i] + 32768) >> 16);
+}
+#endif
 
-     For inverse FFT, use Wm = exp(+j2π/m)
-  */
+#if FIXED_POINT
+static int qOffset = 2048;  // offset removed from the last frame
+#endif
 
-  unsigned int N = 1 << log2_N;
-  double theta_2pi = (direction == FFT_FORWARD) ? -PI : PI;
-  theta_2pi *= 2;
+// Real part of FFT bin i, as used by the features and the display
+int binValue (int i) {
+#if FIXED_POINT
+  return q15_unscale(qsound[2 * i], qExponent) + offsetLeak(qOffset, i);
+#else
+  return (int)creal(sound[i]);
+#endif
+}
 
-  for (unsigned int r = 1; r <= log2_N; r++)
-  {
-    unsigned int m = 1 << r;
-    unsigned int md2 = m >> 1;
-    double theta = theta_2pi / m;
-    double re = cos(theta);
-    double im = sin(theta);
-    double complex Wm = re + I * im;
-    for (unsigned int n = 0; n < N; n += m) {
-      double complex Wmk = 1.0f;   /* Use double for precision */
-      for (unsigned int k = 0; k < md2; k++) {
-        unsigned int i_e = n + k;
-        unsigned int i_o = i_e + md2;
-        double complex t = Wmk * data[i_o];
-        data[i_o] = data[i_e] - t;
-        data[i_e] = data[i_e] + t;
-        t = Wmk * Wm;
-        Wmk = t;
-      }
-    }
-  }
+// Values of the bins 0 ... SAMPLES / 2 - 1 of the last FFT
+void spectrumValues (int32_t *bins) {
+  for (int i = 0; i < SAMPLES / 2; i++) bins[i] = binValue(i);
 }
 
-void ffti_f(float complex data[], unsigned int log2_N, fft_dir direction)
-{
-  ffti_shuffle_f(data, log2_N);
-  ffti_evaluate_f(data, log2_N, direction);
+// Magnitudes of the bins 0 ... SAMPLES / 2 - 1 of the last FFT
+void spectrumColumn (float *column) {
+#if FIXED_POINT
+  column[0] = q15_unscale(abs(qsound[0]), qExponent);
+  for (int i = 1; i < SAMPLES / 2; i++)
+    column[i] = q15_unscale(q15_magnitude(qsound[2 * i], qsound[2 * i + 1]), qExponent);
+#else
+  column[0] = fabsf(crealf(sound[0])); // the imaginary part is the Nyquist bin
+  for (int i = 1; i < SAMPLES / 2; i++) column[i] = cabsf(sound[i]);
+#endif
 }
 
-int mean(int i1, int i2) {
+int mean(const int32_t *bins, int i1, int i2) {
   unsigned long sum = 0;
-  for (int i = i1; i < i2; i++) sum += abs(creal(sound[i]));
+  for (int i = i1; i < i2; i++) sum += abs(bins[i]);
   sum /= (i2 - i1);
   return (int)sum;
 }
 
-int acquireAmplitude () {
+// Peak to peak amplitude of the first ms of a captured frame
+int acquireAmplitude (const uint16_t *frame) {
   unsigned int signalMax = 0;
   unsigned int signalMin = 4096;
-  unsigned long chrono = micros(); // Sample window 1 ms
-  while (micros() - chrono < 1000ul) {
-    int sample = analogRead(A0);
+  for (int i = 0; i < MAX_FREQ; i++) { // Sample window 1 ms
+    int sample = frame[i];
     if (sample > signalMax) signalMax = sample;
     else if (sample < signalMin) signalMin = sample;
   }
   unsigned int peakToPeak = signalMax - signalMin;
   int amplitude = peakToPeak - 70;
-  constrain(amplitude, 0, 500);
+  amplitude = constrain(amplitude, 0, 500);
   return amplitude;
 }
 
-void acquireSound () {
+#if FIXED_POINT
+void acquireSound (const uint16_t *frame) {
+  static int dc = 2048; // offset of the microphone signal (previous frame)
+  static const int16_t *coef = q15_table(window_table(HAMMING, LOG2SAMPLE), SAMPLES);
+  const uint16_t *slot = rfft_slots(LOG2SAMPLE); // bit-reversed order
+  qOffset = dc;
+  long sum = 0;
+  int peak = 0;
   for (int i = 0; i < SAMPLES; i++) {
-    unsigned long chrono = micros();
-    sound[i] = analogRead(A0);
-    while (micros() - chrono < sampling_period_us); // do nothing
+    int sample = frame[i];
+    // Windowed Q15 sample, straight into its FFT input slot
+    int16_t x = q15_sample(sample, dc, coef[i]);
+    qsound[slot[i]] = x;
+    sum += sample;
+    if (abs(x) > peak) peak = abs(x);
   }
-  window (sound, LOG2SAMPLE, HAMMING, FFT_FORWARD);
-  ffti_f(sound, LOG2SAMPLE, FFT_FORWARD);
+  dc = sum / SAMPLES;
+  qExponent = rfft_q15_evaluate(qsound, LOG2SAMPLE, peak);
+}
+#else
+void acquireSound (const uint16_t *frame) {
+  float *samples = (float *) sound; // real samples, then FFT bins
+  const uint16_t *slot = rfft_slots(LOG2SAMPLE); // bit-reversed order
+  const float *coef = window_table(HAMMING, LOG2SAMPLE);
+  // Windowed samples, straight into their FFT input slots
+  for (int i = 0; i < SAMPLES; i++) samples[slot[i]] = frame[i] * coef[i];
+  rfft_evaluate_f(samples, LOG2SAMPLE);
+}
+#endif
+
+// Spectrum view: the bars are updated in place under the frequency
+// labels, which are drawn only after a full redraw
+const uint16_t spectrumColors[1] = {WHITE};
+specview spectrumView;
+
+void oledFill (int x, int y, int w, int h, uint16_t color) {
+  display.setColor((OLEDDISPLAY_COLOR) color);
+  display.fillRect(x, y, w, h);
+}
+
+void initSpectrumView () {
+  const int labels = 13; // height of the labels
+  specview_init(&spectrumView, 0, display.height(), display.width(), display.height() - labels,
+                oledFill, BLACK, WHITE, spectrumColors, 1, 0);
 }
 
-void displaySpectrum () {
+void displaySpectrum (const int32_t *bins) {
   display.setFont(ArialMT_Plain_10);
-  int nFreq = display.width();
-  int hauteur = display.height();
-  display.clear();
-  display.setTextAlignment(TEXT_ALIGN_CENTER);
-  float freqs[10] = {.5, 1, 2, 3, 4, 6, 8, 10, 12, 15};
-  float FREQmax = MAX_FREQ * 128.0 / SAMPLES;
-  for (int i = 0; i < 10; i++) {
-    int pos =  FREQ2IND * freqs[i] ;
-    if (pos > display.width() + 1) break;
-    if (i == 0)display.drawString(pos, 0, ".5");
-    else display.drawString(pos, 0, String(freqs[i], 0));
+  int nFreq = min(display.width(), SAMPLES / 2);
+  if (specview_begin(&spectrumView, false)) {
+    display.clear();
+    display.setTextAlignment(TEXT_ALIGN_CENTER);
+    float freqs[10] = {.5, 1, 2, 3, 4, 6, 8, 10, 12, 15};
+    for (int i = 0; i < 10; i++) {
+      int pos =  FREQ2IND * freqs[i] ;
+      if (pos > display.width() + 1) break;
+      if (i == 0)display.drawString(pos, 0, ".5");
+      else display.drawString(pos, 0, String(freqs[i], 0));
+    }
   }
-  display.setTextAlignment(TEXT_ALIGN_LEFT);
 
   // Affichage du spectre
   int ampmax = 0;
   int imax = 0;
   for (int i = 2; i < nFreq; i++) { // SAMPLES / 2
-    int amplitude = (int)creal(sound[i]) / COEF;
+    int amplitude = bins[i] / COEF;
     if (amplitude > ampmax) {
       ampmax = amplitude;
       imax = i;
     }
-    amplitude = min(amplitude, hauteur);
-    display.drawVerticalLine (i, hauteur - amplitude, amplitude);
+    specview_bar(&spectrumView, i, 1, amplitude, -1);
   }
 
-  // Affichage fréquence de plus forte amplitude
+  // Affichage fréquence de plus forte amplitude, effacée par les barres
+  static int textX = 0, textW = 0;
+  specview_repaint(&spectrumView, textX, 20, textW, 13);
   int freqmax = 985.0 * imax * MAX_FREQ / SAMPLES;
   char text[14];
   sprintf(text, "%4d Hz: %d", freqmax, ampmax);
   // Serial.println(text);
+  display.setColor(WHITE);
   display.setTextAlignment(TEXT_ALIGN_RIGHT);
   display.drawString(128, 20, text);
-  display.display();
+  textW = display.getStringWidth(text);
+  textX = 128 - textW;
+  oled_present(&oled, display.buffer);
 }
 
-void acquisition () {
-  // Acquire 1 sample
-  acquireSound();
-  int amp = acquireAmplitude ();
-  displaySpectrum();
+// Band features (band means, then amplitude) / ATT, and with the
+// fixed-point FFT the same features quantized to int8 into q8, the
+// input of the quantized network (TinnQ8.h)
+void bandFeatures (const int32_t *bins, int amp, float *features, int8_t *q8) {
   int valMax = 0;
   int nFreqs = SAMPLES / bands / 2;
   for (int i = 0; i < bands; i++) {
     int ind1 = i * nFreqs;
     int ind2 = ind1 + nFreqs;
     if (ind1 == 0) ind1 = 3;
-    recorded[i] = mean(ind1, ind2);
-    if (recorded[i] > valMax) valMax = recorded[i];
+    features[i] = mean(bins, ind1, ind2);
+    if (features[i] > valMax) valMax = features[i];
+#if FIXED_POINT
+    q8[i] = q15_quantize(features[i], featureQuant[i]);
+#endif
   }
-  recorded[bands] = amp;
+  features[bands] = amp;
+#if FIXED_POINT
+  q8[bands] = q15_quantize(amp, featureQuant[bands]);
+#else
+  (void) q8;  // no int8 features with the float FFT
+#endif
 //  if (amp > valMax) valMax = amp;
-//  for (int i = 0; i < bands; i++) recorded[i] /= valMax;
-  for (int i = 0; i <= bands; i++) recorded[i] /= ATT;
+//  for (int i = 0; i < bands; i++) features[i] /= valMax;
+  for (int i = 0; i <= bands; i++) features[i] /= ATT;
+}
+
+// Empties the STFT history: the next frame comes from new hops only
+void restartAnalysis () {
+  stft_reset(&stft);
+}
+
+// Analyses the next hop of samples: values of the bins (spectrumValues)
+// and amplitude of the new STFT frame, and its spectrogram column.
+// Returns false while the STFT history is not full.
+bool analyseHop (const uint16_t *hop, int32_t *bins, int *amp) {
+  const uint16_t *frame = stft_push(&stft, hop);
+  if (frame == NULL) return false;
+  *amp = acquireAmplitude(frame);
+  float *column = stft_next_column(&stft);
+  acquireSound(frame);
+  spectrumValues(bins);
+  spectrumColumn(column);
+  return true;
+}
+
+// Processes the next hop of samples. Returns true when a new STFT frame
+// gave new features (recorded, featuresQ8) and a new spectrogram column.
+bool acquisition () {
+  static int32_t bins[SAMPLES / 2];
+  static unsigned long displayed = 0;
+  // Acquire 1 hop: the oldest one captured in the background
+  const uint16_t *hop = capture_wait();
+  if (hop == NULL) return false;
+  // Hops dropped by the capture (too slow): no frame across the gap
+  if (!capture_contiguous(hop)) restartAnalysis();
+  int amp;
+  bool ready = analyseHop(hop, bins, &amp);
+  capture_release();
+  if (!ready) return false;  // history not full yet
+  if (millis() - displayed >= DISPLAY_PERIOD) {
+    displayed = millis();
+    displaySpectrum(bins);
+  }
+  bandFeatures(bins, amp, recorded, featuresQ8);
+  return true;
 }
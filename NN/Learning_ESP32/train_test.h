@@ -6,7 +6,7 @@
    - Print performances
 */
 
-Tinn createAndTrain() {
+Network createAndTrain() {
   // Read the dataset file
   int rows = init(datasetFile, 1); // number of samples
 
@@ -21,16 +21,41 @@ Tinn createAndTrain() {
   int nTrain = ratio * rows;    // size of training datset
   int nTest = rows - nTrain;    // size of testing dataset
 
-  // Create the training set
-  Data data = ndata(nips, nops, nTrain);
-  for (int row = 0; row < nTrain; row++) {
-    for (int col = 0; col < nips; col++)
-      data.in[row][col] = input[row][col];
-    data.tg[row][0] = output[row];
-  }
+  // The training set: a view of the first nTrain rows of the shuffled
+  // dataset, no copy. Streamed from flash, only a batch is in RAM, read
+  // at each epoch.
+#if DATASET_BIN
+  float* batch = (float*) malloc(BATCH * (nips + nops) * sizeof(float));
+#else
+  const DataView data = {input[0], maxInput, output, 1, datasetOrder, nTrain};
+#endif
+  // Batches: a new permutation of the training set at each epoch of the
+  // sampler, balanced snore / silence if STRATIFIED
+  sampler batches;
+  uint8_t* labels = NULL;
+#if STRATIFIED
+  labels = (uint8_t*) malloc(nTrain);
+  for (int i = 0; i < nTrain; i++) labels[i] = getLabel(i);
+#endif
+  sampler_init(&batches, nTrain, labels, shuffleSeed(1));
+  free(labels);
 
   // Train, baby, train...
+#if DENSE
+  const int hidden[] = DENSE_HIDDEN;
+  const int nlayers = sizeof(hidden) / sizeof(hidden[0]) + 1;
+  int sizes[nlayers + 1], acts[nlayers];
+  sizes[0] = nips;
+  for (int l = 1; l < nlayers; l++) {
+    sizes[l] = hidden[l - 1];
+    acts[l - 1] = ACTIVATION;
+  }
+  sizes[nlayers] = nops;
+  acts[nlayers - 1] = SIGMOID; // SIGMOID at output layer
+  const Dense tinn = xtbuild(nlayers, sizes, acts);
+#else
   const Tinn tinn = xtbuild(nips, nhid, nops);
+#endif
   display.clear();
   display.setFont(ArialMT_Plain_16);
   display.setTextAlignment(TEXT_ALIGN_CENTER);
@@ -44,14 +69,26 @@ Tinn createAndTrain() {
   Serial.printf("\nTraining... on batches of %d data\n", nBatch);
   unsigned long chrono = millis();
   for (int i = 0; i < epochs + 1; i++) {
-    // take nBatch random data from the training dataset for training
-    shuffle(data, nBatch, nTrain);
-    error = 0.0f;
+    // take the next nBatch data of the training dataset
+    int pos[nBatch];
+    const float* in[nBatch];
+    const float* tg[nBatch];
+    sampler_batch(&batches, pos, nBatch);
     for (int j = 0; j < nBatch; j++) {
-      const float* const in = data.in[j];
-      const float* const tg = data.tg[j];
-      error += xttrain(tinn, in, tg, rate);
+#if DATASET_BIN
+      getSample(pos[j], in[j], tg[j], batch + j * nips, batch + BATCH * nips + j * nops);
+#else
+      in[j] = viewIn(data, pos[j]);
+      tg[j] = viewTg(data, pos[j]);
+#endif
     }
+#if BATCHED && !DENSE
+    error = xttrainbatch(tinn, in, tg, nBatch, rate);
+#else
+    error = 0.0f;
+    for (int j = 0; j < nBatch; j++)
+      error += xttrain(tinn, in[j], tg[j], rate);
+#endif
     err = error / nBatch * 100.0;
     if (err < MAXERR && i > 2000) {
       Serial.printf("Epoch %4d\tError %7.4f\tLearning rate %.3f\n",
@@ -67,10 +104,19 @@ Tinn createAndTrain() {
     display.display();
   }
   chrono = millis() - chrono;
-  Serial.printf ("Training done in %u ms\n", chrono);
+  Serial.printf ("Training done in %u ms, %lu epochs of the training set\n",
+                 chrono, batches.epochs);
+  sampler_free(&batches);
   // Save network
   Serial.println("Saving network on SPIFFS");
-  xtsave(tinn, "/Network.txt");
+#if NETWORK_BIN && !DENSE
+  xtsavebin(tinn, networkFile, TINN_BIN_FLOAT);
+#ifdef NETWORK_PARTITION
+  xtflashbin(networkFile, NETWORK_PARTITION);
+#endif
+#else
+  xtsave(tinn, networkFile);
+#endif
 
   // Now test the network on test data (not used for training)
   Serial.println("\nTesting on unknown data...");
@@ -80,23 +126,21 @@ Tinn createAndTrain() {
   display.drawString(64, 5, "Training done in");
   sprintf(text, "%d ms", chrono);
   display.drawString(64, 20, text);
-  sprintf(text, "Error rate %.2f %%", error / data.rows * 100.0);
+  sprintf(text, "Error rate %.2f %%", err);
   display.drawString(64, 40, text);
   display.display();
   delay(1500);
 
-  // Create the testing set
-  Data test = ndata(nips, nops, nTest);
-  for (int row = 0; row < nTest; row++) {
-    for (int col = 0; col < nips; col++)
-      test.in[row][col] = input[nTrain + row][col];
-    test.tg[row][0] = output[nTrain + row];
-  }
-  // Test the network
+#if DATASET_BIN
+  free(batch);
+#endif
+
+  // Test the network, the testing set follows the training set
+  float inBuf[nips], tgBuf[nops];
   int Nerrs = 0;
   for (int sample = 0; sample < nTest; sample++) {
-    const float* const in = test.in[sample];
-    const float* const tg = test.tg[sample];
+    const float *in, *tg;
+    getSample(nTrain + sample, in, tg, inBuf, tgBuf);
     const float* const pd = xtpredict(tinn, in);
     char text[4] = "OK ";
     if (abs(tg[0] - pd[0]) > 0.2) {
@@ -112,8 +156,8 @@ Tinn createAndTrain() {
   // Test over training set
   Nerrs = 0;
   for (int sample = 0; sample < nTrain; sample++) {
-    const float* const in = data.in[sample];
-    const float* const tg = data.tg[sample];
+    const float *in, *tg;
+    getSample(sample, in, tg, inBuf, tgBuf);
     const float* const pd = xtpredict(tinn, in);
     if (abs(tg[0] - pd[0]) > 0.2) ++Nerrs;
   }
@@ -136,24 +180,17 @@ void splash () {
   delay(1500);
 }
 
-void testNetwork (Tinn tinn) {
+void testNetwork (Network tinn) {
   // Read the dataset file
   int rows = init(datasetFile, 0); // number of samples
-  // Create the dataset
   int nips = tinn.nips;
-  int nhid = tinn.nhid;
   int nops = tinn.nops;
-  Data data = ndata(nips, nops, rows);
-  for (int row = 0; row < rows; row++) {
-    for (int col = 0; col < nips; col++)
-      data.in[row][col] = input[row][col];
-    data.tg[row][0] = output[row];
-  }
   // Test over entire dataset
+  float inBuf[nips], tgBuf[nops];
   int Nerrs = 0;
   for (int sample = 0; sample < rows; sample++) {
-    const float* const in = data.in[sample];
-    const float* const tg = data.tg[sample];
+    const float *in, *tg;
+    getSample(sample, in, tg, inBuf, tgBuf);
     const float* const pd = xtpredict(tinn, in);
     if (abs(tg[0] - pd[0]) > 0.2) ++Nerrs;
   }
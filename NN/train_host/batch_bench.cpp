@@ -0,0 +1,139 @@
+/*
+   Training throughput of Tinn: one update per sample against per batch
+
+   Trains the network of Learning_ESP32 on a Data.txt, as createAndTrain
+   does (batches of BATCH rows from sampler.h, EPOCHS epochs, LR annealed
+   by ANNEAL), from the same initial weights:
+     per sample   xttrain on each row of the batch (BATCHED 0)
+     batched      xttrainbatch, the averaged gradient of the batch and
+                  one update (BATCHED 1), at the same rate
+     summed       the same with the gradients summed (rate x batch), as
+                  xttrainbatch did before the average
+   Prints the samples per second, the final training error of each and
+   the error rates on the testing and training sets.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 batch_bench.cpp -o batch_bench
+     ./batch_bench [-e epochs] [-b batch] [Data.txt]
+*/
+#include <chrono>
+#include <vector>
+
+#include "host_shims.h"
+#undef BATCHED
+#define BATCHED 1  // xttrainbatch, t.g and t.work allocated by xtbuild
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/sampler.h"
+
+// Dataset as read by train_host: bands + 1 inputs, the label last
+static std::vector<float> inputs, labels;
+static int nips;
+
+static int readDataset(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return 0;
+  char line[1024];
+  if (fgets(line, sizeof(line), f) == NULL) {
+    fclose(f);
+    return 0;
+  }
+  nips = atoi(line) + 1;
+  std::vector<float> row;
+  int rows = 0;
+  while (fgets(line, sizeof(line), f)) {
+    row.clear();
+    char* p = line;
+    char* end;
+    for (float v = strtof(p, &end); end != p; v = strtof(p, &end)) {
+      row.push_back(v);
+      p = end;
+    }
+    if (row.size() < 2) continue;
+    const float label = row.back();
+    row.pop_back();
+    row.resize(nips, 0.0f);
+    for (int i = 0; i < nips; i++) inputs.push_back(row[i] / ATT);
+    labels.push_back(label);
+    ++rows;
+  }
+  fclose(f);
+  return rows;
+}
+
+// Error rate of t on the rows first ... last - 1
+static float test(const Tinn& t, int first, int last)
+{
+  int errs = 0;
+  for (int row = first; row < last; row++) {
+    const float* const pd = xtpredict(t, &inputs[row * nips]);
+    if (fabsf(labels[row] - pd[0]) > 0.2f) ++errs;
+  }
+  return (last > first) ? errs * 100.0f / (last - first) : 0.0f;
+}
+
+typedef enum {PER_SAMPLE, BATCHED_MEAN, BATCHED_SUM} trainMode;
+
+int main(int argc, char** argv)
+{
+  int epochs = EPOCHS, nBatch = BATCH;
+  const char* path = "../../UPLOAD_SPIFFS/data/Data.txt";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-e") && i + 1 < argc) epochs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) nBatch = atoi(argv[++i]);
+    else path = argv[i];
+  }
+  const int rows = readDataset(path);
+  if (rows == 0) {
+    fprintf(stderr, "%s - failed to read the dataset\n", path);
+    return 1;
+  }
+  // Shuffle the rows before the split, like finish()
+  xoshiro128 shuffle;
+  xoshiro_seed(&shuffle, 1);
+  for (int i = rows - 1; i > 0; i--) {
+    const int j = xoshiro_below(&shuffle, i + 1);
+    std::swap_ranges(&inputs[i * nips], &inputs[(i + 1) * nips], &inputs[j * nips]);
+    std::swap(labels[i], labels[j]);
+  }
+  const int nTrain = RATIO * rows;
+  if (nBatch > nTrain) nBatch = nTrain;
+  if (nBatch > BATCH) nBatch = BATCH;  // size of t.work
+  printf("%s: %d samples of %d inputs, training on %d, %d epochs of batches of %d, LR %g\n\n",
+         path, rows, nips, nTrain, epochs, nBatch, (double) LR);
+  printf("%-12s %12s %12s %12s %12s\n", "update", "samples/s", "last error", "test err %", "train err %");
+
+  const char* names[] = {"per sample", "batched", "summed"};
+  for (int mode = PER_SAMPLE; mode <= BATCHED_SUM; mode++) {
+    rng.seed(1);
+    const Tinn t = xtbuild(nips, NHID, Noutput);
+    sampler batches;
+    sampler_init(&batches, nTrain, NULL, 1);
+    std::vector<int> pos(nBatch);
+    std::vector<const float*> in(nBatch), tg(nBatch);
+    float rate = LR, err = 0;
+    long samples = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < epochs + 1; i++) {
+      sampler_batch(&batches, pos.data(), nBatch);
+      for (int s = 0; s < nBatch; s++) {
+        in[s] = &inputs[pos[s] * nips];
+        tg[s] = &labels[pos[s]];
+      }
+      float error = 0.0f;
+      if (mode == PER_SAMPLE)
+        for (int s = 0; s < nBatch; s++) error += xttrain(t, in[s], tg[s], rate);
+      else
+        error = xttrainbatch(t, in.data(), tg.data(), nBatch, (mode == BATCHED_SUM) ? rate * nBatch : rate);
+      err = error / nBatch * 100.0;
+      samples += nBatch;
+      rate *= ANNEAL;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-12s %12.0f %12.4f %12.2f %12.2f\n", names[mode], samples / elapsed.count(), err,
+           (double) test(t, nTrain, rows), (double) test(t, 0, nTrain));
+    sampler_free(&batches);
+    xtfree(t);
+  }
+  return 0;
+}
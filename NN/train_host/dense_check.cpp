@@ -0,0 +1,263 @@
+/*
+   Dense network with several hidden layers (Dense.h): forward pass,
+   back propagation, training and saved file
+
+     - forward pass: xtpredict against a reference in double, one neuron
+       at a time, for 1 to 3 hidden layers and both activations; and
+       against the xtpredict of Tinn.h, for one hidden layer with the
+       weights of a tinn and its biases (one per layer in a tinn)
+     - back propagation: the weight and bias changes of one xttrain at a
+       small rate, against the gradient of the error by finite
+       differences
+     - training: the network of Learning_ESP32 with DENSE 1 (DENSE_HIDDEN,
+       LR 0.3), trained as createAndTrain does (batches of the sampler,
+       one update per sample) on a Data.txt: error rates of the training
+       and testing sets
+     - save and load: the outputs of the trained network, saved with
+       xtsave and read back by xtloaddense, within the 6 decimals of the
+       text file
+   Fails if a difference is above its bound, or if the training error
+   rate is above MAX_TRAIN_ERROR.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 dense_check.cpp -o dense_check
+     ./dense_check [-e epochs] [Data.txt]
+*/
+#include <vector>
+
+#include "host_shims.h"
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/Dense.h"
+#include "../Learning_ESP32/sampler.h"
+
+#define MAX_OUTPUT_ERROR 1e-5    // forward pass, float against double
+#define MAX_GRADIENT_ERROR 1e-2  // relative to the largest gradient
+#define MAX_TRAIN_ERROR 10.0     // % of the training set
+#define MAX_FILE_ERROR 1e-4      // outputs after save and load
+#define DENSE_RATE 0.3f          // learning rate of DENSE_HIDDEN
+
+// Dense network of the given hidden layer sizes and activation, the
+// output layer a sigmoid
+static Dense build(int nips, const std::vector<int>& hidden, int nops, int act)
+{
+  int sizes[DENSE_MAX_LAYERS + 1], acts[DENSE_MAX_LAYERS];
+  const int nlayers = hidden.size() + 1;
+  sizes[0] = nips;
+  for (int l = 1; l < nlayers; l++) {
+    sizes[l] = hidden[l - 1];
+    acts[l - 1] = act;
+  }
+  sizes[nlayers] = nops;
+  acts[nlayers - 1] = SIGMOID;
+  return xtbuild(nlayers, sizes, acts);
+}
+
+// Forward pass in double, one neuron at a time
+static std::vector<double> reference(const Dense& t, const float* in)
+{
+  std::vector<double> x(in, in + t.nips);
+  for (int l = 0; l < t.nlayers; l++) {
+    std::vector<double> y(t.size[l + 1]);
+    for (int i = 0; i < t.size[l + 1]; i++) {
+      double sum = t.b[l][i];
+      for (int j = 0; j < t.size[l]; j++) sum += (double) t.w[l][i * t.size[l] + j] * x[j];
+      y[i] = (t.act[l] == SIGMOID) ? 1 / (1 + exp(-sum)) : (sum > 0 ? sum : 0);
+    }
+    x = y;
+  }
+  return x;
+}
+
+static float error(const Dense& t, const float* in, const float* tg)
+{
+  return toterr(tg, xtpredict(t, in), t.nops);
+}
+
+// Largest difference between the changes of one xttrain and -rate x the
+// gradient of the error by central differences, relative to the largest
+// gradient
+static double gradientError(const Dense& t, const float* in, const float* tg)
+{
+  const float rate = 1e-3f, h = 1e-3f;
+  std::vector<float> saved(t.arena, t.a[0]);  // weights and biases
+  std::vector<double> numeric;
+  std::vector<float*> params;
+  for (int l = 0; l < t.nlayers; l++) {
+    for (int i = 0; i < t.size[l + 1] * t.size[l]; i++) params.push_back(&t.w[l][i]);
+    for (int i = 0; i < t.size[l + 1]; i++) params.push_back(&t.b[l][i]);
+  }
+  for (float* p : params) {
+    const float v = *p;
+    *p = v + h;
+    const double up = error(t, in, tg);
+    *p = v - h;
+    const double down = error(t, in, tg);
+    *p = v;
+    numeric.push_back((up - down) / (2 * h));
+  }
+  xttrain(t, in, tg, rate);
+  double worst = 0, largest = 0;
+  for (size_t k = 0; k < params.size(); k++) {
+    const double backprop = (saved[params[k] - t.arena] - *params[k]) / rate;
+    worst = fmax(worst, fabs(backprop - numeric[k]));
+    largest = fmax(largest, fabs(numeric[k]));
+  }
+  std::copy(saved.begin(), saved.end(), t.arena);
+  return (largest > 0) ? worst / largest : 0;
+}
+
+// Dataset, as train_host reads it: bands + 1 inputs / ATT and a label
+static std::vector<float> inputs, labels;
+static int nips;
+
+static int readDataset(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return 0;
+  char line[1024];
+  if (fgets(line, sizeof(line), f) == NULL) {
+    fclose(f);
+    return 0;
+  }
+  nips = atoi(line) + 1;
+  std::vector<float> row;
+  int rows = 0;
+  while (fgets(line, sizeof(line), f)) {
+    row.clear();
+    char* p = line;
+    char* end;
+    for (float v = strtof(p, &end); end != p; v = strtof(p, &end)) {
+      row.push_back(v);
+      p = end;
+    }
+    if (row.size() < 2) continue;
+    const float label = row.back();
+    row.pop_back();
+    row.resize(nips, 0.0f);
+    for (int i = 0; i < nips; i++) inputs.push_back(row[i] / ATT);
+    labels.push_back(label);
+    ++rows;
+  }
+  fclose(f);
+  return rows;
+}
+
+// Error rate of t on the rows first ... last - 1
+static float test(const Dense& t, int first, int last)
+{
+  int errs = 0;
+  for (int row = first; row < last; row++)
+    if (fabsf(labels[row] - xtpredict(t, &inputs[row * nips])[0]) > 0.2f) ++errs;
+  return (last > first) ? errs * 100.0f / (last - first) : 0.0f;
+}
+
+int main(int argc, char** argv)
+{
+  int epochs = EPOCHS;
+  const char* dataFile = "../../UPLOAD_SPIFFS/data/Data.txt";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-e") && i + 1 < argc) epochs = atoi(argv[++i]);
+    else dataFile = argv[i];
+  }
+  bool ok = true;
+
+  // Forward pass and back propagation
+  printf("%-16s %-8s %14s %15s\n", "network", "hidden", "output error", "gradient error");
+  const std::vector<std::vector<int>> stacks = {{NHID}, {NHID, 16}, {24, 16, 8}};
+  for (const std::vector<int>& hidden : stacks)
+    for (int act = SIGMOID; act <= RELU; act++) {
+      const Dense t = build(17, hidden, 2, act);
+      std::vector<float> in(t.nips), tg = {1, 0};
+      double output = 0, gradient = 0;
+      for (int n = 0; n < 50; n++) {
+        for (float& v : in) v = frand() * 2;
+        const float* o = xtpredict(t, in.data());
+        const std::vector<double> r = reference(t, in.data());
+        for (int k = 0; k < t.nops; k++) output = fmax(output, fabs(o[k] - r[k]));
+        if (n < 5) gradient = fmax(gradient, gradientError(t, in.data(), tg.data()));
+      }
+      char name[32] = "17";
+      for (int h : hidden) snprintf(name + strlen(name), sizeof(name) - strlen(name), "-%d", h);
+      strcat(name, "-2");
+      printf("%-16s %-8s %14.3g %15.3g\n", name, act == SIGMOID ? "sigmoid" : "relu", output, gradient);
+      if (output > MAX_OUTPUT_ERROR || gradient > MAX_GRADIENT_ERROR) ok = false;
+      xtfree(t);
+    }
+
+  // One hidden layer: same outputs as a tinn with the same weights
+  const Tinn tinn = xtbuild(17, NHID, Noutput);
+  const Dense one = build(17, {NHID}, Noutput, ACTIVATION);
+  for (int i = 0; i < NHID; i++) {
+    for (int j = 0; j < 17; j++) one.w[0][i * 17 + j] = tinn.w[widx(tinn, i, j)];
+    one.b[0][i] = tinn.b[0];
+    one.w[1][i] = tinn.x[i];
+  }
+  one.b[1][0] = tinn.b[1];
+  double tinnError = 0;
+  float in[17];
+  for (int n = 0; n < 100; n++) {
+    for (float& v : in) v = frand() * 2;
+    tinnError = fmax(tinnError, fabs(xtpredict(one, in)[0] - xtpredict(tinn, in)[0]));
+  }
+  printf("\n17-%d-1 against Tinn.h: output error %.3g\n", NHID, tinnError);
+  if (tinnError > MAX_OUTPUT_ERROR) ok = false;
+  xtfree(one);
+  xtfree(tinn);
+
+  // Training of the network of the sketch, as createAndTrain
+  const int rows = readDataset(dataFile);
+  if (rows == 0) {
+    fprintf(stderr, "%s - no data\n", dataFile);
+    return 1;
+  }
+  const int nTrain = RATIO * rows;
+  const std::vector<int> hidden = DENSE_HIDDEN;
+  const Dense t = build(nips, hidden, Noutput, ACTIVATION);
+  sampler batches;
+  sampler_init(&batches, nTrain, NULL, 1);
+  const int nBatch = (BATCH < nTrain) ? BATCH : nTrain;
+  std::vector<int> pos(nBatch);
+  float rate = DENSE_RATE, first = -1, last = 0;
+  for (int e = 0; e <= epochs; e++) {
+    sampler_batch(&batches, pos.data(), nBatch);
+    float err = 0;
+    for (int p : pos) err += xttrain(t, &inputs[p * nips], &labels[p], rate);
+    last = err / nBatch * 100;
+    if (first < 0) first = last;
+    rate *= ANNEAL;
+  }
+  sampler_free(&batches);
+  const float trainError = test(t, 0, nTrain), testError = test(t, nTrain, rows);
+  printf("\n%s, %d rows, %d-", dataFile, rows, nips);
+  for (int h : hidden) printf("%d-", h);
+  printf("%d, %d epochs of batches of %d at LR %g\n", Noutput, epochs, nBatch, DENSE_RATE);
+  printf("batch error %.4f -> %.4f, error rate %.2f%% on the training set, %.2f%% on the testing set\n",
+         first, last, trainError, testError);
+  if (trainError > MAX_TRAIN_ERROR) ok = false;
+
+  // Save and load
+  const char* networkFile = "dense_check.txt";
+  xtsave(t, networkFile);
+  const Dense loaded = xtloaddense(networkFile);
+  remove(networkFile);
+  double fileError = 0;
+  bool same = loaded.nlayers == t.nlayers;
+  for (int l = 0; same && l < t.nlayers; l++)
+    same = loaded.size[l + 1] == t.size[l + 1] && loaded.act[l] == t.act[l];
+  for (int row = 0; same && row < rows; row++)
+    fileError = fmax(fileError, fabs(xtpredict(loaded, &inputs[row * nips])[0]
+                                     - xtpredict(t, &inputs[row * nips])[0]));
+  printf("save and load: %s, output error %.3g\n", same ? "same layers" : "other layers", fileError);
+  if (!same || fileError > MAX_FILE_ERROR) ok = false;
+  xtfree(loaded);
+  xtfree(t);
+
+  printf("\noutput error: max |xtpredict - double reference| (bound %g)\n"
+         "gradient error: max |xttrain change / rate - finite difference gradient|\n"
+         "                / largest gradient (bound %g)\n"
+         "training: error rate of the training set (bound %g%%)\n"
+         "save and load: max |loaded - saved network| on the dataset (bound %g)\n",
+         MAX_OUTPUT_ERROR, MAX_GRADIENT_ERROR, MAX_TRAIN_ERROR, MAX_FILE_ERROR);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/*
+   Speed and accuracy of the FFT engine of fft.h
+
+   Runs ffti_f of fft.h (twiddle tables, radix-4 passes in float) and
+   the routine it replaced in the sketches (radix-2 butterflies in
+   double, each twiddle by a product of the previous one, kept below as
+   the reference) on the same frames of noise, for N = 256, 512 and
+   1024. Prints the frames per second of both and the max error of
+   fft.h against the reference, relative to the largest bin of the
+   frame.
+
+   Then for real samples (the ADC values), rfft_f (an N/2 points complex
+   FFT and a split step) against ffti_f on the same samples as complex
+   values: the speed of both and the max error of the N/2 + 1 bins of
+   rfft_f (the others are their conjugates).
+
+   Build and run:
+     g++ -O2 -std=gnu++17 fft_bench.cpp -o fft_bench
+     ./fft_bench [frames]
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#define complex _Complex
+#define I (__extension__ 1.0iF)
+#define cabsf(z) __builtin_cabsf(z)
+#include "../Learning_ESP32/fft.h"
+
+// The FFT of sound_functions.h before fft.h
+namespace reference
+{
+typedef enum fft_dir {
+  FFT_FORWARD,
+  FFT_INVERSE
+} fft_dir;
+
+void ffti_shuffle_f(float complex *data, unsigned int log2_N)
+{
+  unsigned int N = 1 << log2_N;
+  unsigned int Nd2 = N >> 1;
+  unsigned int Nm1 = N - 1;
+  unsigned int i, j;
+  for (i = 0, j = 0; i < N; i++) {
+    if (j > i) {
+      float complex tmp = data[i];
+      data[i] = data[j];
+      data[j] = tmp;
+    }
+    unsigned int lszb = ~i & (i + 1);
+    unsigned int mszb = Nd2 / lszb;
+    unsigned int bits = Nm1 & ~(mszb - 1);
+    j ^= bits;
+  }
+}
+
+void ffti_evaluate_f(float complex *data, unsigned int log2_N, fft_dir direction)
+{
+  unsigned int N = 1 << log2_N;
+  double theta_2pi = (direction == FFT_FORWARD) ? -M_PI : M_PI;
+  theta_2pi *= 2;
+  for (unsigned int r = 1; r <= log2_N; r++) {
+    unsigned int m = 1 << r;
+    unsigned int md2 = m >> 1;
+    double theta = theta_2pi / m;
+    double complex Wm = cos(theta) + I * sin(theta);
+    for (unsigned int n = 0; n < N; n += m) {
+      double complex Wmk = 1.0f;
+      for (unsigned int k = 0; k < md2; k++) {
+        unsigned int i_e = n + k;
+        unsigned int i_o = i_e + md2;
+        double complex t = Wmk * data[i_o];
+        data[i_o] = data[i_e] - t;
+        data[i_e] = data[i_e] + t;
+        Wmk = Wmk * Wm;
+      }
+    }
+  }
+}
+
+void ffti_f(float complex data[], unsigned int log2_N, fft_dir direction)
+{
+  ffti_shuffle_f(data, log2_N);
+  ffti_evaluate_f(data, log2_N, direction);
+}
+}
+
+static double now_us()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Largest |a - b| over the largest |b| of a frame
+static double error(const float complex *a, const float complex *b, int n)
+{
+  double worst = 0, largest = 0;
+  for (int k = 0; k < n; k++) {
+    worst = fmax(worst, cabsf(a[k] - b[k]));
+    largest = fmax(largest, cabsf(b[k]));
+  }
+  return worst / largest;
+}
+
+int main(int argc, char** argv)
+{
+  const int frames = (argc > 1) ? atoi(argv[1]) : 2000;
+  srand(1);
+  printf("%d frames of noise (centered ADC values)\n\n", frames);
+  printf("%6s %22s %22s %7s %10s\n", "N", "reference frames/s", "fft.h frames/s", "speedup", "max error");
+  for (unsigned int log2_N = 8; log2_N <= 10; log2_N++) {
+    const int N = 1 << log2_N;
+    std::vector<float complex> input(frames * N), ref(frames * N), out(frames * N);
+    for (int i = 0; i < frames * N; i++) input[i] = rand() % 4096 - 2048;
+    fft_init(log2_N);
+
+    memcpy(ref.data(), input.data(), input.size() * sizeof(float complex));
+    double start = now_us();
+    for (int f = 0; f < frames; f++) reference::ffti_f(&ref[f * N], log2_N, reference::FFT_FORWARD);
+    const double refUs = (now_us() - start) / frames;
+
+    memcpy(out.data(), input.data(), input.size() * sizeof(float complex));
+    start = now_us();
+    for (int f = 0; f < frames; f++) ffti_f(&out[f * N], log2_N, FFT_FORWARD);
+    const double us = (now_us() - start) / frames;
+
+    double worst = 0;
+    for (int f = 0; f < frames; f++) worst = fmax(worst, error(&out[f * N], &ref[f * N], N));
+    printf("%6d %22.0f %22.0f %6.1fx %10.2g\n", N, 1e6 / refUs, 1e6 / us, refUs / us, worst);
+    fft_free(log2_N);
+  }
+
+  printf("\n%6s %22s %22s %7s %10s\n", "N", "ffti_f frames/s", "rfft_f frames/s", "speedup", "max error");
+  for (unsigned int log2_N = 8; log2_N <= 10; log2_N++) {
+    const int N = 1 << log2_N;
+    std::vector<float> input(frames * N), real(frames * N);
+    std::vector<float complex> full(frames * N);
+    for (int i = 0; i < frames * N; i++) input[i] = rand() % 4096 - 2048;
+    fft_init(log2_N);
+    rfft_init(log2_N);
+
+    for (int i = 0; i < frames * N; i++) full[i] = input[i];
+    double start = now_us();
+    for (int f = 0; f < frames; f++) ffti_f(&full[f * N], log2_N, FFT_FORWARD);
+    const double fullUs = (now_us() - start) / frames;
+
+    memcpy(real.data(), input.data(), input.size() * sizeof(float));
+    start = now_us();
+    for (int f = 0; f < frames; f++) rfft_f(&real[f * N], log2_N);
+    const double us = (now_us() - start) / frames;
+
+    // Bins 0 ... N/2: the real Nyquist bin is in the imaginary part of bin 0
+    double worst = 0;
+    std::vector<float complex> bins(N / 2 + 1);
+    for (int f = 0; f < frames; f++) {
+      const float complex *X = (const float complex *) &real[f * N];
+      for (int k = 1; k < N / 2; k++) bins[k] = X[k];
+      bins[0] = real[f * N];
+      bins[N / 2] = real[f * N + 1];
+      worst = fmax(worst, error(bins.data(), &full[f * N], N / 2 + 1));
+    }
+    printf("%6d %22.0f %22.0f %6.1fx %10.2g\n", N, 1e6 / fullUs, 1e6 / us, fullUs / us, worst);
+    fft_free(log2_N);
+    fft_free(log2_N - 1);
+  }
+  return 0;
+}
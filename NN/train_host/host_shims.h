@@ -0,0 +1,62 @@
+/*
+   What Tinn.h and TinnBin.h use from the Arduino core and the SPIFFS,
+   on a PC: files are plain files, Serial is stdout, esp_random is a
+   seeded Mersenne twister.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+
+#include "../Learning_ESP32/params.h"
+#define Noutput 1  // as in Learning_ESP32.ino
+
+static std::mt19937 rng(1);
+static uint32_t esp_random() { return rng(); }
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+
+class File
+{
+  public:
+    File(FILE* f = NULL) : f(f) {}
+    operator bool() const { return f != NULL; }
+    bool isDirectory() const { return false; }
+    int available() {
+      int c = fgetc(f);
+      if (c == EOF) return 0;
+      ungetc(c, f);
+      return 1;
+    }
+    int read() { return fgetc(f); }
+    size_t read(uint8_t* buf, size_t size) { return fread(buf, 1, size, f); }
+    size_t write(const uint8_t* buf, size_t size) { return fwrite(buf, 1, size, f); }
+    size_t size() {
+      long pos = ftell(f);
+      fseek(f, 0, SEEK_END);
+      long size = ftell(f);
+      fseek(f, pos, SEEK_SET);
+      return size;
+    }
+    template <typename... Args>
+    int printf(const char* format, Args... args) { return fprintf(f, format, args...); }
+    void close() { fclose(f); }
+  private:
+    FILE* f;
+};
+
+struct
+{
+  File open(const char* path, const char* mode = FILE_READ) {
+    return File(fopen(path, (mode[0] == 'w') ? "wb" : "rb"));
+  }
+} SPIFFS;
+
+struct
+{
+  template <typename... Args>
+  int printf(const char* format, Args... args) { return ::printf(format, args...); }
+} Serial;
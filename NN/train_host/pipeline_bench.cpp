@@ -0,0 +1,195 @@
+/*
+   Task pipeline against the sequential loop of Learning_ESP32
+
+   Replays WAV files (capture.h, first channel as 12-bit ADC samples at
+   MAX_FREQ kHz) through the processing of the sketch, run as loop()
+   does (PIPELINE 0: capture, STFT frame, features, prediction and
+   display one after the other) and as the task pipeline (PIPELINE 1:
+   the stages of the sketch in threads, linked by frame rings). The
+   display is the background flush service, on a simulated I2C bus.
+
+   Two replays of each file:
+     real time   the capture rate of the sketch: frames dropped by the
+                 capture and end-to-end latency, from the capture of a
+                 hop to the output of its prediction
+     unpaced     the samples as fast as the replay can read them:
+                 throughput, in frames analysed per second. The capture
+                 ring holds a whole file (CAPTURE_SLOTS 512, 4 in the
+                 sketch), so no frame is dropped; the latency is then
+                 mostly the wait in the ring.
+   The pause of the sketch after a detection is left out. With a single
+   processor the threads of the pipeline only take turns: it needs 2
+   cores to gain.
+
+   The network is a Network.txt (-n), else random weights.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 -pthread pipeline_bench.cpp -o pipeline_bench
+     ./pipeline_bench [-n Network.txt] [file.wav ...]
+*/
+#include <vector>
+
+#define CAPTURE_SLOTS 512  // 65 s at 20 kHz: the hops of a whole file
+#include "sketch_host.h"
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/pipeline.h"
+#include "../Learning_ESP32/sound_functions.h"
+
+Tinn tinn;
+
+// The stages of Learning_ESP32.ino
+typedef struct {
+  unsigned long captured;     // capture time of the hop (capture_time)
+  int32_t bins[SAMPLES / 2];  // spectrum
+  int amp;                    // peak to peak amplitude
+  float features[maxInput];   // band features, amplitude
+  int8_t q8[maxInput];        // int8 features (FIXED_POINT)
+  float score;                // network output
+} pipeItem;
+frame_ring featureQueue, predictQueue, displayQueue;
+pipe_latency latency;
+
+// The items are passed by pointer (pipeline.h): 2 in each of the 3
+// queues and 1 filled by the fft stage
+#define PIPE_ITEMS 8
+pipe_pool itemPool;
+
+bool fftStage (const void *in, void *out) {
+  static pipeItem *item = NULL;  // filled until a frame is complete
+  if (item == NULL) item = (pipeItem *) pipe_pool_take(&itemPool);
+  if (item == NULL) return false;  // none free: the hop is dropped
+  const uint16_t *hop = (const uint16_t *) in;
+  item->captured = capture_time(hop);
+  if (!capture_contiguous(hop)) restartAnalysis();
+  if (!analyseHop(hop, item->bins, &item->amp)) return false;
+  pipe_pass(out, item);
+  item = NULL;
+  return true;
+}
+
+bool featureStage (const void *in, void *out) {
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  bandFeatures(item->bins, item->amp, item->features, item->q8);
+  pipe_pass(out, item);
+  return true;
+}
+
+bool predictStage (const void *in, void *out) {
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  item->score = xtpredict(tinn, item->features)[0];
+  pipe_pass(out, item);
+  return true;
+}
+
+bool displayStage (const void *in, void *out) {
+  (void) out;  // last stage
+  static unsigned long displayed = 0;
+  pipeItem *item = (pipeItem *) pipe_item(in);
+  if (millis() - displayed >= DISPLAY_PERIOD) {
+    displayed = millis();
+    displaySpectrum(item->bins);
+  }
+  pipe_latency_add(&latency, item->captured);
+  pipe_pool_give(&itemPool, item);
+  return true;
+}
+
+pipe_stage stages[] = {
+  {"fft",      fftStage,     &captureRing,  &featureQueue, 0, {}},
+  {"features", featureStage, &featureQueue, &predictQueue, 0, {}},
+  {"predict",  predictStage, &predictQueue, &displayQueue, 1, {}},
+  {"display",  displayStage, &displayQueue, NULL,          1, {}}
+};
+#define NSTAGES (sizeof(stages) / sizeof(stages[0]))
+
+typedef struct {
+  unsigned long frames, dropped;
+  double seconds;
+  pipe_latency latency;
+} benchResult;
+
+// loop() of the sketch, the hops captured in the background
+static void sequential()
+{
+  static int32_t bins[SAMPLES / 2];
+  static unsigned long displayed = 0;
+  const uint16_t *hop;
+  while ((hop = capture_wait()) != NULL) {
+    const unsigned long captured = capture_time(hop);
+    if (!capture_contiguous(hop)) restartAnalysis();
+    int amp;
+    bool ready = analyseHop(hop, bins, &amp);
+    capture_release();
+    if (!ready) continue;
+    if (millis() - displayed >= DISPLAY_PERIOD) {
+      displayed = millis();
+      displaySpectrum(bins);
+    }
+    bandFeatures(bins, amp, recorded, featuresQ8);
+    xtpredict(tinn, recorded);
+    pipe_latency_add(&latency, captured);
+  }
+}
+
+static benchResult bench(const char *path, float speed, bool pipelined)
+{
+  benchResult r;
+  stft_reset(&stft);
+  latency.items = latency.maxUs = latency.totalUs = 0;
+  capture_wav(path, speed);
+  const unsigned long start = micros();
+  if (!capture_begin(MAX_FREQ * 1000ul, HOP)) {
+    r.frames = 0;
+    return r;
+  }
+  if (pipelined) {
+    pipe_start(stages, NSTAGES);
+    while (capture_running()) delay(1);
+    pipe_stop(stages, NSTAGES);
+  } else sequential();
+  r.seconds = (micros() - start) * 1e-6;
+  capture_end();
+  r.frames = latency.items;
+  r.dropped = capture_overruns();
+  r.latency = latency;
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  const char* networkFile = NULL;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) networkFile = argv[++i];
+    else files.push_back(argv[i]);
+  }
+  if (files.empty()) files = {"../../Spectogram/0_0.wav", "../../Spectogram/1_0.wav"};
+  tinn = networkFile ? xtload(networkFile) : xtbuild(bands + 1, NHID, Noutput);
+  if (!sketch_begin() || !ring_init(&featureQueue, 2, sizeof(void *))
+      || !ring_init(&predictQueue, 2, sizeof(void *)) || !ring_init(&displayQueue, 2, sizeof(void *))
+      || !pipe_pool_init(&itemPool, PIPE_ITEMS, sizeof(pipeItem))
+      || !oled_begin(&oled, 0x3c, display.width(), display.height(), DISPLAY_PERIOD)) {
+    fprintf(stderr, "not enough memory\n");
+    return 1;
+  }
+  initSpectrumView();
+  printf("Hops of %d samples at %d kHz, frames of %d samples, %u threads\n\n",
+         HOP, MAX_FREQ, SAMPLES, std::thread::hardware_concurrency());
+  printf("%-26s %-10s %-11s %7s %8s %9s %12s %11s\n", "", "replay", "loop", "frames", "dropped",
+         "frames/s", "latency us", "max us");
+  for (const char* path : files)
+    for (float speed = 1; speed >= 0; speed -= 1)
+      for (int pipelined = 0; pipelined <= 1; pipelined++) {
+        const benchResult r = bench(path, speed, pipelined);
+        if (r.frames == 0) {
+          fprintf(stderr, "%s - not a 16-bit PCM WAV file\n", path);
+          return 1;
+        }
+        printf("%-26s %-10s %-11s %7lu %8lu %9.0f %12lu %11lu\n", path, speed ? "real time" : "unpaced",
+               pipelined ? "pipeline" : "sequential", r.frames, r.dropped, r.frames / r.seconds,
+               (unsigned long) (r.latency.totalUs / r.frames), r.latency.maxUs);
+        if (pipelined && speed == 0) pipe_report(stages, NSTAGES);
+      }
+  oled_end(&oled);
+  return 0;
+}
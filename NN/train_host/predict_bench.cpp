@@ -0,0 +1,120 @@
+/*
+   Predictions per second of Tinn: blocked forward pass against the old one
+
+   Times xtpredict of Tinn.h (input to hidden weights by blocks of
+   TINN_BLOCK neurons, TINN_BLOCK sums per pass over the inputs in a
+   tinn_vec, activation resolved at compile time) and the forward pass it
+   replaced (one neuron at a time on row-major weights, the activation
+   chosen by a switch, kept below as the reference), on the same weights
+   and random inputs. The sizes are those of Learning_ESP32 (16 or 32
+   bands and the amplitude, NHID hidden neurons, one output) and a few
+   larger ones. Prints the predictions per second of both, the speedup
+   and the largest difference of the outputs, which fails above
+   MAX_OUTPUT_ERROR (the sums are taken in another order).
+
+   The ESP32 has no SIMD unit: there the gain is the TINN_BLOCK sums kept
+   in registers, each input read once per block.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 predict_bench.cpp -o predict_bench
+     ./predict_bench [predictions]
+*/
+#include <chrono>
+#include <vector>
+
+#include "host_shims.h"
+#include "../Learning_ESP32/Tinn.h"
+
+#define MAX_OUTPUT_ERROR 1e-5
+
+// xtpredict of Tinn.h before the blocked layout
+namespace reference
+{
+static float act(const float a, int actNumber)
+{
+  switch (actNumber) {
+    case SIGMOID:
+      return 1.0f / (1.0f + expf(-a));
+      break;
+    case RELU:
+    default:
+      return (a > 0) ? a : 0;
+  }
+}
+
+// w: nhid x nips input to hidden weights, then nops x nhid hidden to
+// output weights
+static float* xtpredict(const float* w, const float* b, float* h, float* o,
+                        int nips, int nhid, int nops, const float* in)
+{
+  const float* x = w + nhid * nips;
+  for (int i = 0; i < nhid; i++)
+  {
+    float sum = 0.0f;
+    for (int j = 0; j < nips; j++)
+      sum += in[j] * w[i * nips + j];
+    h[i] = act(sum + b[0], ACTIVATION);
+  }
+  for (int i = 0; i < nops; i++)
+  {
+    float sum = 0.0f;
+    for (int j = 0; j < nhid; j++)
+      sum += h[j] * x[i * nhid + j];
+    o[i] = act(sum + b[1], SIGMOID);
+  }
+  return o;
+}
+}
+
+static double now_us()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  const int predictions = (argc > 1) ? atoi(argv[1]) : 200000;
+  const int sizes[][3] = {{17, NHID, 1}, {33, NHID, 1}, {33, 64, 2}, {129, 128, 4}};
+  const int inputs = 256;  // distinct input vectors, cycled
+  printf("%d predictions, TINN_BLOCK %d\n\n", predictions, TINN_BLOCK);
+  printf("%-12s %16s %16s %9s %12s\n", "network", "old pred/s", "blocked pred/s", "speedup", "max diff");
+  bool ok = true;
+  for (const int* size : sizes) {
+    const int nips = size[0], nhid = size[1], nops = size[2];
+    const Tinn t = xtbuild(nips, nhid, nops);
+    // Same weights, row-major
+    std::vector<float> w(nhid * (nips + nops)), h(nhid), o(nops);
+    for (int i = 0; i < nhid; i++)
+      for (int j = 0; j < nips; j++) w[i * nips + j] = t.w[widx(t, i, j)];
+    for (int i = 0; i < nhid * nops; i++) w[nhid * nips + i] = t.x[i];
+    std::vector<float> in(inputs * nips);
+    for (float& v : in) v = frand();
+
+    volatile float sink = 0;  // keeps the predictions
+    double start = now_us();
+    for (int n = 0; n < predictions; n++)
+      sink += reference::xtpredict(w.data(), t.b, h.data(), o.data(), nips, nhid, nops,
+                                   &in[(n % inputs) * nips])[0];
+    const double oldUs = now_us() - start;
+    start = now_us();
+    for (int n = 0; n < predictions; n++)
+      sink += xtpredict(t, &in[(n % inputs) * nips])[0];
+    const double newUs = now_us() - start;
+
+    double diff = 0;
+    for (int n = 0; n < inputs; n++) {
+      reference::xtpredict(w.data(), t.b, h.data(), o.data(), nips, nhid, nops, &in[n * nips]);
+      const float* p = xtpredict(t, &in[n * nips]);
+      for (int k = 0; k < nops; k++) diff = fmax(diff, fabs(p[k] - o[k]));
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%d-%d-%d", nips, nhid, nops);
+    printf("%-12s %16.0f %16.0f %9.2f %12.3g\n", name, predictions / oldUs * 1e6,
+           predictions / newUs * 1e6, oldUs / newUs, diff);
+    if (diff > MAX_OUTPUT_ERROR) ok = false;
+    xtfree(t);
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+/*
+   Fixed-point pipeline against the float one, on recordings
+
+   Runs the acquisition of Learning_ESP32 twice on the hops of WAV files
+   (the recordings of Spectogram by default, first channel as 12-bit ADC
+   samples):
+   once as FIXED_POINT 0 (float FFT, float features), once as
+   FIXED_POINT 1 (Q15 window, block floating point FFT, integer
+   magnitudes and band means, int8 features). The int8 features are
+   calibrated first, as setup() does on the dataset: each one maps 0 ...
+   Q8_HEADROOM x its largest float value over the recordings (or over the
+   rows of a Data.txt, -d) on the int8 range (xtcalibrate). Then for each
+   STFT frame it compares
+     - the features / ATT of both paths: their difference beyond the
+       rounding of the integer band means (1 / ATT), relative to the
+       largest feature of the frame
+     - the int8 features, dequantized, with the fixed-point features, in
+       quantization steps of the feature, the features above the int8
+       range excepted (the frames with one are counted as clamped)
+     - on every frame, clamped or not, the output of the quantized
+       network (TinnQ8.h) on the int8 features with the output of the
+       float network on the float features, and the detections (output
+       > DETECT) of both: a frame detected by one network only fails the
+       check, unless its float output is within MAX_DETECT_MARGIN of
+       DETECT (the rounding of both quantizations, 8 bits inputs and
+       weights, moves the output by a few %)
+   and fails if a deviation is above its bound.
+
+   The network is a Network.txt of the sketch or of train_host (-n),
+   else random weights.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 q15_check.cpp -o q15_check
+     ./q15_check [-n Network.txt] [-d Data.txt] [file.wav ...]
+*/
+#include <vector>
+
+#include "sketch_host.h"
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/TinnQ8.h"
+
+// Both variants of the acquisition
+#undef FIXED_POINT
+#define FIXED_POINT 0
+namespace floating
+{
+#include "../Learning_ESP32/sound_functions.h"
+}
+#undef FIXED_POINT
+#define FIXED_POINT 1
+namespace fixed
+{
+#include "../Learning_ESP32/sound_functions.h"
+}
+
+// Bounds of the deviations
+#define MAX_FEATURE_ERROR 0.01   // relative to the largest feature
+#define MAX_INT8_ERROR 0.6       // quantization steps: half a step, and the
+                                 // rounding of the multiplier of q15_quantize
+#define MAX_OUTPUT_ERROR 0.1     // network output, 0 ... 1
+#define MAX_DETECT_MARGIN 0.02   // float output from DETECT of a frame
+                                 // detected by one network only
+
+// First channel of a 16-bit PCM WAV file, as the ADC samples of capture.h
+static std::vector<uint16_t> readWav(const char* path)
+{
+  std::vector<uint16_t> adc;
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) return adc;
+  uint32_t dataSize = 0;
+  const int channels = capture_wav_header(f, &dataSize);
+  int16_t frame[8];
+  if (channels >= 1 && channels <= 8)
+    for (uint32_t n = dataSize / (channels * sizeof(int16_t)); n > 0; n--) {
+      if (fread(frame, sizeof(int16_t), channels, f) != (size_t) channels) break;
+      adc.push_back((frame[0] >> 4) + 2048);
+    }
+  fclose(f);
+  return adc;
+}
+
+typedef struct {
+  std::vector<float> features;
+  std::vector<int8_t> q8;
+} frameFeatures;
+
+// Features of each STFT frame of the samples, with the acquisition of
+// one variant
+template <bool (*analyse)(const uint16_t*, int32_t*, int*),
+          void (*features)(const int32_t*, int, float*, int8_t*)>
+static std::vector<frameFeatures> run(const std::vector<uint16_t>& adc)
+{
+  std::vector<frameFeatures> frames;
+  free(stft.hist);
+  free(stft.spec);
+  stft_init(&stft, SAMPLES, HOP, SAMPLES / 2, STFT_COLUMNS);
+  int32_t bins[SAMPLES / 2];
+  for (size_t pos = 0; pos + HOP <= adc.size(); pos += HOP) {
+    int amp;
+    if (!analyse(&adc[pos], bins, &amp)) continue;
+    frameFeatures f;
+    f.features.resize(bands + 1);
+    f.q8.resize(bands + 1);
+    features(bins, amp, f.features.data(), f.q8.data());
+    frames.push_back(f);
+  }
+  return frames;
+}
+
+// Largest value of each feature over the rows of a Data.txt (the
+// features / ATT, as init() reads them)
+static bool datasetRange(const char* path, std::vector<float>& top)
+{
+  FILE* f = fopen(path, "r");
+  int n = 0;
+  if (f == NULL || fscanf(f, "%d", &n) != 1 || n != bands) {
+    if (f != NULL) fclose(f);
+    return false;
+  }
+  float v;
+  for (int i = 0; fscanf(f, "%f", &v) == 1; i = (i + 1) % (bands + 2))
+    if (i <= bands) top[i] = fmax(top[i], v / ATT);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  const char* networkFile = NULL;
+  const char* datasetFile = NULL;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) networkFile = argv[++i];
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc) datasetFile = argv[++i];
+    else files.push_back(argv[i]);
+  }
+  if (files.empty()) files = {"../../Spectogram/0_0.wav", "../../Spectogram/1_0.wav"};
+  if (!sketch_begin() || !fixed::windowLeakInit()) {
+    fprintf(stderr, "not enough memory\n");
+    return 1;
+  }
+  const Tinn t = networkFile ? xtload(networkFile) : xtbuild(bands + 1, NHID, Noutput);
+  if (t.nips != bands + 1) {
+    fprintf(stderr, "%s - %d inputs, the features are %d\n", networkFile, t.nips, bands + 1);
+    return 1;
+  }
+
+  // Float features of the recordings, and the calibration of the int8
+  // features on their range (or on the range of a dataset)
+  std::vector<std::vector<uint16_t>> adc;
+  std::vector<std::vector<frameFeatures>> fl;
+  std::vector<float> top(bands + 1, 0.0f);
+  for (const char* path : files) {
+    adc.push_back(readWav(path));
+    if (adc.back().size() < SAMPLES) {
+      fprintf(stderr, "%s - not a 16-bit PCM WAV file\n", path);
+      return 1;
+    }
+    fl.push_back(run<floating::analyseHop, floating::bandFeatures>(adc.back()));
+    for (const frameFeatures& f : fl.back())
+      for (int i = 0; i <= bands; i++) top[i] = fmax(top[i], f.features[i]);
+  }
+  if (datasetFile != NULL) {
+    std::fill(top.begin(), top.end(), 0.0f);
+    if (!datasetRange(datasetFile, top)) {
+      fprintf(stderr, "%s - not a dataset of %d bands\n", datasetFile, bands);
+      return 1;
+    }
+  }
+  float scale[maxInput];
+  int zero[maxInput];
+  xtcalibrate(top.data(), bands + 1, Q8_HEADROOM, ATT, scale, zero);
+  for (int i = 0; i <= bands; i++) featureQuant[i] = q15_quant_init(scale[i], zero[i], ATT);
+  const TinnQ8 q = xtquantize(t, scale, zero);
+  if (q.w == NULL) {
+    fprintf(stderr, "not enough memory\n");
+    return 1;
+  }
+  printf("Network: %s, features: %d bands and the amplitude\n",
+         networkFile ? networkFile : "random weights", bands);
+  printf("int8 steps, calibrated on %s:", datasetFile ? datasetFile : "the recordings");
+  for (int i = 0; i <= bands; i++) printf(" %.3g", scale[i]);
+  printf("\n\n%-26s %7s %14s %14s %10s %12s %12s %7s\n", "", "frames", "feature error", "int8 error",
+         "clamped", "output error", "detections", "flips");
+
+  bool ok = true;
+  for (size_t file = 0; file < files.size(); file++) {
+    const std::vector<frameFeatures> fx = run<fixed::analyseHop, fixed::bandFeatures>(adc[file]);
+    double featureError = 0, q8Error = 0, outputError = 0;
+    int clamped = 0, detections[2] = {0, 0}, flips = 0;
+    for (size_t f = 0; f < fl[file].size() && f < fx.size(); f++) {
+      const float* a = fl[file][f].features.data();
+      const float* b = fx[f].features.data();
+      double largest = 0, worst = 0;
+      bool inRange = true;
+      for (int i = 0; i <= bands; i++) {
+        largest = fmax(largest, a[i]);
+        worst = fmax(worst, fabs(a[i] - b[i]) - 1 / ATT);
+        // Dequantized int8 feature against the fixed-point one
+        const float v = (fx[f].q8[i] - zero[i]) * scale[i];
+        if (b[i] > (127 - zero[i]) * scale[i]) inRange = false;
+        else q8Error = fmax(q8Error, fabs(v - b[i]) / scale[i]);
+      }
+      if (largest > 0) featureError = fmax(featureError, worst / largest);
+      clamped += !inRange;
+      // The network is compared on every frame, clamped or not
+      const float pf = xtpredict(t, a)[0];
+      const float pq = xtpredictq8(q, fx[f].q8.data())[0];
+      outputError = fmax(outputError, fabs(pf - pq));
+      detections[0] += pf > DETECT;
+      detections[1] += pq > DETECT;
+      if ((pf > DETECT) != (pq > DETECT)) {
+        flips++;
+        if (fabs(pf - DETECT) > MAX_DETECT_MARGIN) ok = false;
+      }
+    }
+    char detected[24];
+    snprintf(detected, sizeof(detected), "%d/%d", detections[0], detections[1]);
+    printf("%-26s %7zu %14.3g %14.3g %10d %12.3g %12s %7d\n", files[file], fl[file].size(), featureError,
+           q8Error, clamped, outputError, detected, flips);
+    if (fl[file].size() != fx.size() || featureError > MAX_FEATURE_ERROR
+        || q8Error > MAX_INT8_ERROR
+        || outputError > MAX_OUTPUT_ERROR) ok = false;
+  }
+  printf("\nfeature error: max (|fixed - float| - 1 / ATT) / largest feature of the frame (bound %g)\n"
+         "int8 error: max |dequantized int8 - fixed-point feature| in int8 steps of the feature\n"
+         "            (bound %g), the features above the int8 range excepted\n"
+         "clamped: frames with a feature above the int8 range (compared all the same)\n"
+         "output error: max |quantized network - float network| on all frames (bound %g)\n"
+         "detections: frames above DETECT, float / fixed-point\n"
+         "flips: frames detected by one network only, which fail the check unless the\n"
+         "       float output is within %g of DETECT\n",
+         MAX_FEATURE_ERROR, MAX_INT8_ERROR, MAX_OUTPUT_ERROR, MAX_DETECT_MARGIN);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  xtfreeq8(q);
+  xtfree(t);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+   The sound processing of Learning_ESP32 on a PC
+
+   What sound_functions.h uses from the Arduino core and the display
+   library (the drawing is discarded, the display keeps its buffer), the
+   headers of the sketch and its globals, as in Learning_ESP32.ino. A
+   tool then includes sound_functions.h and runs the acquisition and the
+   features of the sketch on WAV files replayed by capture.h.
+
+   The globals of both variants (FIXED_POINT) are defined, so that a
+   tool may change this switch of params.h before including
+   sound_functions.h, or include it once per variant, each in its own
+   namespace.
+*/
+#include <float.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "host_shims.h"
+
+// Arduino core
+typedef uint8_t byte;
+using std::min;
+using std::max;
+#define PI M_PI
+#define sq(x) ((x) * (x))
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+#define complex _Complex
+#define I (__extension__ 1.0iF)
+#define creal(z) __builtin_creal(z)
+#define crealf(z) __builtin_crealf(z)
+#define cimagf(z) __builtin_cimagf(z)
+#define cabsf(z) __builtin_cabsf(z)
+
+inline unsigned long micros()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+class String : public std::string
+{
+  public:
+    String(const char* s) : std::string(s) {}
+    String(float x, int decimals)
+    {
+      char text[24];
+      snprintf(text, sizeof(text), "%.*f", decimals, (double) x);
+      assign(text);
+    }
+};
+
+// SSD1306 display: nothing is drawn
+typedef enum {BLACK, WHITE, INVERSE} OLEDDISPLAY_COLOR;
+enum {TEXT_ALIGN_LEFT, TEXT_ALIGN_CENTER, TEXT_ALIGN_RIGHT};
+static const uint8_t ArialMT_Plain_10[1] = {0}, ArialMT_Plain_16[1] = {0}, ArialMT_Plain_24[1] = {0};
+
+class SSD1306
+{
+  public:
+    uint8_t buffer[128 * 64 / 8] = {0};
+    void init() {}
+    void clear() {}
+    void display() {}
+    int width() const { return 128; }
+    int height() const { return 64; }
+    void setFont(const uint8_t*) {}
+    void setTextAlignment(int) {}
+    void setColor(OLEDDISPLAY_COLOR) {}
+    void drawString(int, int, const String&) {}
+    void fillRect(int, int, int, int) {}
+    void drawRect(int, int, int, int) {}
+    int getStringWidth(const char* s) const { return 6 * strlen(s); }
+};
+
+// Headers and globals of Learning_ESP32.ino
+#define FREQ2IND (SAMPLES * 1.0 / MAX_FREQ)
+SSD1306 display;
+#include "../Learning_ESP32/specview.h"
+#include "../Learning_ESP32/oled_flush.h"
+#include "../Learning_ESP32/fft.h"
+#include "../Learning_ESP32/fft_q15.h"
+#include "../Learning_ESP32/ring.h"
+#include "../Learning_ESP32/capture.h"
+#include "../Learning_ESP32/stft.h"
+
+#define maxRows 1460
+#define maxInput 17
+float recorded[maxInput];
+int bands = 16;
+float complex sound[SAMPLES / 2];
+stft_state stft;
+int LOG2SAMPLE = log(SAMPLES) / log(2);
+int16_t qsound[SAMPLES];
+int qExponent = 0;
+int8_t featuresQ8[maxInput];
+q15_quant featureQuant[maxInput];
+oled_flush oled;
+
+// Starts the analysis of WAV files as in setup(): the tables of the
+// FFTs and the STFT history (the feature quantization is calibrated by
+// the tool, as setup() does on the dataset)
+inline bool sketch_begin()
+{
+  return rfft_init(LOG2SAMPLE) && rfft_q15_init(LOG2SAMPLE)
+         && stft_init(&stft, SAMPLES, HOP, SAMPLES / 2, STFT_COLUMNS);
+}
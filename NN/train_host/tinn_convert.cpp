@@ -0,0 +1,52 @@
+/*
+   Converts a network between the text format (/Network.txt, xtsave) and
+   the binary format of TinnBin.h, in both directions: the type of the
+   input file is found from its first bytes.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 tinn_convert.cpp -o tinn_convert
+     ./tinn_convert [-q] Network.txt Network.bin   text to binary, -q: int8 weights
+     ./tinn_convert Network.bin Network.txt        binary to text
+   Upload the binary file to the SPIFFS, or write it directly into the
+   flash partition of the network, for instance with parttool.py:
+     parttool.py write_partition --partition-name network --input Network.bin
+*/
+#include "host_shims.h"
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/TinnBin.h"
+
+int main(int argc, char** argv)
+{
+  int dtype = TINN_BIN_FLOAT;
+  const char* files[2] = {NULL, NULL};
+  int nFiles = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-q")) dtype = TINN_BIN_INT8;
+    else if (nFiles < 2) files[nFiles++] = argv[i];
+  }
+  if (files[1] == NULL) {
+    fprintf(stderr, "usage: %s [-q] Network.txt Network.bin\n"
+            "       %s Network.bin Network.txt\n", argv[0], argv[0]);
+    return 1;
+  }
+  FILE* f = fopen(files[0], "rb");
+  uint32_t magic = 0;
+  if (f == NULL || fread(&magic, sizeof(magic), 1, f) != 1) {
+    fprintf(stderr, "%s - failed to read the network\n", files[0]);
+    return 1;
+  }
+  fclose(f);
+
+  Tinn t;
+  if (magic == TINN_BIN_MAGIC) {
+    if (!xtloadbin(t, files[0])) return 1;
+    xtsave(t, files[1]);
+  } else {
+    t = xtload(files[0]);
+    if (!xtsavebin(t, files[1], dtype)) return 1;
+  }
+  printf("%s -> %s: %d inputs, %d hidden neurons, %d outputs\n",
+         files[0], files[1], t.nips, t.nhid, t.nops);
+  xtfree(t);
+  return 0;
+}
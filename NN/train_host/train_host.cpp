@@ -0,0 +1,296 @@
+/*
+   Host trainer for the snore detector network
+
+   Trains the network of Learning_ESP32 on a PC, with the same Tinn.h and
+   params.h, from the Data.txt of the SPIFFS (UPLOAD_SPIFFS/data), and
+   writes a Network.txt that xtload reads on the ESP32 (upload it to the
+   SPIFFS as /Network.txt).
+
+   Data parallel: each mini batch is split between the threads, each one
+   adds the gradient of its slice into its own buffer (xtgrad), the
+   buffers are summed by pairs (tree reduction, log2(threads) steps done
+   in parallel), and the weights are updated once (xtapply), as
+   xttrainbatch does. The threads are started once and synchronized by a
+   barrier between the steps.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 -pthread train_host.cpp -o train_host
+     ./train_host [-t threads] [-e epochs] [-b batch] [-r rate] [-s seed] [--stratified] Data.txt Network.txt
+     ./train_host --scaling [-t max threads] [-e epochs] [-b batch] Data.txt
+   --scaling trains from the same initial weights with 1 ... max threads
+   and prints the speed and the parallel efficiency of each count.
+   The shuffle and the batches come from sampler.h: a run is reproduced
+   with the same seed (SEED of params.h on the ESP32), --stratified
+   balances the snore and silence rows of the batches (STRATIFIED).
+   A Network.bin output file is written in the binary format (TinnBin.h).
+
+   The default parameters are those of params.h. As with BATCHED, the
+   gradient of a batch is averaged: LR of params.h applies.
+*/
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "host_shims.h"
+#include "../Learning_ESP32/Tinn.h"
+#include "../Learning_ESP32/TinnBin.h"
+#include "../Learning_ESP32/sampler.h"
+
+// Dataset: bands + 1 inputs (bands and amplitude) and a label per row.
+// Like init(), the last value of a line is the label and the missing
+// inputs are 0 (files without the amplitude).
+static std::vector<float> inputs, labels;
+static int nips;
+
+static int readDataset(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return 0;
+  char line[1024];
+  if (fgets(line, sizeof(line), f) == NULL) {
+    fclose(f);
+    return 0;
+  }
+  nips = atoi(line) + 1;
+  std::vector<float> row;
+  int rows = 0;
+  while (fgets(line, sizeof(line), f)) {
+    row.clear();
+    char* p = line;
+    char* end;
+    for (float v = strtof(p, &end); end != p; v = strtof(p, &end)) {
+      row.push_back(v);
+      p = end;
+    }
+    if (row.size() < 2) continue;
+    const float label = row.back();
+    row.pop_back();
+    row.resize(nips, 0.0f);
+    for (int i = 0; i < nips; i++) inputs.push_back(row[i] / ATT);
+    labels.push_back(label);
+    ++rows;
+  }
+  fclose(f);
+  return rows;
+}
+
+// Barrier for a fixed number of threads, reusable
+class Barrier
+{
+  public:
+    Barrier(int count) : count(count), waiting(0), generation(0) {}
+    void wait() {
+      std::unique_lock<std::mutex> lock(m);
+      const unsigned long gen = generation;
+      if (++waiting == count) {
+        waiting = 0;
+        ++generation;
+        cv.notify_all();
+      } else cv.wait(lock, [&] { return gen != generation; });
+    }
+  private:
+    std::mutex m;
+    std::condition_variable cv;
+    int count, waiting;
+    unsigned long generation;
+};
+
+// Data parallel trainer: threads - 1 workers plus the calling thread
+class Trainer
+{
+  public:
+    Trainer(const Tinn& t, int threads, int batch)
+      : t(t), threads(threads), batch(batch), size(xtwsize(t)), sync(threads),
+        grad(threads), work(threads), errors(threads)
+    {
+      const int slice = (batch + threads - 1) / threads;
+      for (int k = 0; k < threads; k++) {
+        grad[k].resize(size);
+        work[k].resize(xtworksize(t, slice));
+      }
+      for (int k = 1; k < threads; k++) workers.emplace_back(&Trainer::worker, this, k);
+    }
+
+    ~Trainer() {
+      in = NULL;
+      sync.wait();  // wakes the workers up to stop
+      for (auto& w : workers) w.join();
+    }
+
+    // One weight update from n = batch samples, returns the sum of the errors
+    float step(const float* const* in, const float* const* tg, float rate) {
+      this->in = in;
+      this->tg = tg;
+      sync.wait();  // start
+      slice(0);
+      sync.wait();  // all the gradients done
+      reduce(0);
+      xtapply(t, grad[0].data(), rate / batch);  // mean of the batch, as xttrainbatch
+      float error = 0.0f;
+      for (int k = 0; k < threads; k++) error += errors[k];
+      return error;
+    }
+
+  private:
+    // Gradient of the samples of thread k
+    void slice(int k) {
+      const int first = batch * k / threads, last = batch * (k + 1) / threads;
+      float* const g = grad[k].data();
+      memset(g, 0, size * sizeof(float));
+      errors[k] = (last > first) ?
+                  xtgrad(t, in + first, tg + first, last - first, g, work[k].data()) : 0.0f;
+    }
+
+    // Pairwise sum into grad[0]: at each step, thread k adds the buffer
+    // of thread k + stride to its own
+    void reduce(int k) {
+      for (int stride = 1; stride < threads; stride *= 2) {
+        if (k % (2 * stride) == 0 && k + stride < threads) {
+          float* const a = grad[k].data();
+          const float* const b = grad[k + stride].data();
+          for (int i = 0; i < size; i++) a[i] += b[i];
+        }
+        sync.wait();
+      }
+    }
+
+    void worker(int k) {
+      for (;;) {
+        sync.wait();
+        if (in == NULL) return;
+        slice(k);
+        sync.wait();
+        reduce(k);
+      }
+    }
+
+    const Tinn t;
+    const int threads, batch, size;
+    Barrier sync;
+    std::vector<std::vector<float>> grad, work;
+    std::vector<float> errors;
+    std::vector<std::thread> workers;
+    const float* const* in = NULL;
+    const float* const* tg = NULL;
+};
+
+// Trains t, returns the samples per second
+// with the batches of the sampler of the sketch
+static double train(const Tinn& t, int threads, int epochs, int nBatch, int nTrain,
+                    float rate, bool stratified, unsigned seed, bool verbose)
+{
+  sampler batches;
+  std::vector<uint8_t> classes(nTrain);
+  for (int i = 0; i < nTrain; i++) classes[i] = labels[i] > 0.5f;
+  sampler_init(&batches, nTrain, stratified ? classes.data() : NULL, (uint64_t) seed + 1);
+  std::vector<int> pos(nBatch);
+  std::vector<const float*> in(nBatch), tg(nBatch);
+  Trainer trainer(t, threads, nBatch);
+  const int Ndisp = (epochs / 20 > 0) ? epochs / 20 : 1;
+  long samples = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < epochs + 1; i++) {
+    sampler_batch(&batches, pos.data(), nBatch);
+    for (int s = 0; s < nBatch; s++) {
+      in[s] = &inputs[pos[s] * nips];
+      tg[s] = &labels[pos[s]];
+    }
+    const float err = trainer.step(in.data(), tg.data(), rate) / nBatch * 100.0;
+    samples += nBatch;
+    if (verbose && (i % Ndisp == 0 || (err < MAXERR && i > 2000)))
+      printf("Epoch %4d\tError %7.4f\tLearning rate %.3f\n", i, err, (double) rate);
+    if (err < MAXERR && i > 2000) break;
+    rate *= ANNEAL;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  sampler_free(&batches);
+  return samples / elapsed.count();
+}
+
+// Error rate of t on the rows first ... last - 1
+static float test(const Tinn& t, int first, int last)
+{
+  int errs = 0;
+  for (int row = first; row < last; row++) {
+    const float* const pd = xtpredict(t, &inputs[row * nips]);
+    if (fabsf(labels[row] - pd[0]) > 0.2f) ++errs;
+  }
+  return (last > first) ? errs * 100.0f / (last - first) : 0.0f;
+}
+
+int main(int argc, char** argv)
+{
+  int threads = std::thread::hardware_concurrency();
+  int epochs = EPOCHS, nBatch = BATCH;
+  float rate = LR;
+  unsigned seed = 1;
+  bool scaling = false;
+  bool stratified = STRATIFIED;
+  const char* files[2] = {NULL, NULL};
+  int nFiles = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-e") && i + 1 < argc) epochs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) nBatch = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--scaling")) scaling = true;
+    else if (!strcmp(argv[i], "--stratified")) stratified = true;
+    else if (nFiles < 2) files[nFiles++] = argv[i];
+  }
+  if (threads < 1) threads = 1;
+  if (files[0] == NULL || (!scaling && files[1] == NULL)) {
+    fprintf(stderr, "usage: %s [-t threads] [-e epochs] [-b batch] [-r rate] [-s seed] [--stratified] Data.txt Network.txt\n"
+            "       %s --scaling [-t max threads] [-e epochs] [-b batch] Data.txt\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+
+  const int rows = readDataset(files[0]);
+  if (rows == 0) {
+    fprintf(stderr, "%s - failed to read the dataset\n", files[0]);
+    return 1;
+  }
+  // Shuffle the rows before the split, like finish()
+  xoshiro128 shuffle;
+  xoshiro_seed(&shuffle, seed);
+  for (int i = rows - 1; i > 0; i--) {
+    const int j = xoshiro_below(&shuffle, i + 1);
+    std::swap_ranges(&inputs[i * nips], &inputs[(i + 1) * nips], &inputs[j * nips]);
+    std::swap(labels[i], labels[j]);
+  }
+  const int nTrain = RATIO * rows;
+  if (nBatch > nTrain) nBatch = nTrain;
+  printf("Read %d samples of %d inputs, training on %d, batches of %d\n",
+         rows, nips, nTrain, nBatch);
+
+  if (scaling) {
+    printf("Threads  samples/s  speedup  efficiency\n");
+    double base = 0;
+    for (int n = 1; n <= threads; n++) {
+      rng.seed(seed);
+      const Tinn t = xtbuild(nips, NHID, Noutput);
+      const double speed = train(t, n, epochs, nBatch, nTrain, rate, stratified, seed, false);
+      if (n == 1) base = speed;
+      printf("%7d  %9.0f  %7.2f  %9.0f%%\n", n, speed, speed / base, 100.0 * speed / base / n);
+      xtfree(t);
+    }
+    return 0;
+  }
+
+  rng.seed(seed);
+  const Tinn t = xtbuild(nips, NHID, Noutput);
+  printf("Training with %d threads...\n", threads);
+  const double speed = train(t, threads, epochs, nBatch, nTrain, rate, stratified, seed, true);
+  printf("%.0f samples/s\n", speed);
+  printf("Error rate: %.2f%% on the testing set, %.2f%% on the training set\n",
+         (double) test(t, nTrain, rows), (double) test(t, 0, nTrain));
+  const size_t len = strlen(files[1]);
+  if (len > 4 && !strcmp(files[1] + len - 4, ".bin")) xtsavebin(t, files[1], TINN_BIN_FLOAT);
+  else xtsave(t, files[1]);
+  printf("Network saved in %s\n", files[1]);
+  xtfree(t);
+  return 0;
+}
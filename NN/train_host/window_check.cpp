@@ -0,0 +1,50 @@
+/*
+   Window coefficient tables against window()
+
+   For the ten window types of sound_functions.h and N = 2 ... 1024,
+   compares the coefficients of window_table (built once, used by the
+   acquisition) with the reference window(), which computes them in
+   double at each call: window() applied to N ones, real and complex.
+   The real window must give the same floats, the complex one may round
+   differently (it multiplies in double). Prints the largest difference
+   of each type and fails if a table differs.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 window_check.cpp -o window_check
+     ./window_check
+*/
+#include "sketch_host.h"
+#include "../Learning_ESP32/sound_functions.h"
+
+int main()
+{
+  const char* names[WINDOW_TYPES] = {"RECTANGLE", "HAMMING", "HANN", "TRIANGLE", "NUTTALL", "BLACKMAN",
+                                     "BLACKMAN_NUTTALL", "BLACKMAN_HARRIS", "FLT_TOP", "WELCH"
+                                    };
+  static float real[1 << 10];
+  static float complex cplx[1 << 10];
+  bool ok = true;
+  printf("%-17s %12s %12s\n", "window", "real", "complex");
+  for (int type = 0; type < WINDOW_TYPES; type++) {
+    double worstReal = 0, worstComplex = 0;
+    for (unsigned int log2_N = 1; log2_N <= 10; log2_N++) {
+      const unsigned int N = 1 << log2_N;
+      const float* table = window_table(type, log2_N);
+      for (unsigned int i = 0; i < N; i++) {
+        real[i] = 1.0f;
+        cplx[i] = 1.0f;
+      }
+      window(real, log2_N, type, FFT_FORWARD);
+      window(cplx, log2_N, type, FFT_FORWARD);
+      for (unsigned int i = 0; i < N; i++) {
+        worstReal = fmax(worstReal, fabs(table[i] - real[i]));
+        worstComplex = fmax(worstComplex, fabs(table[i] - crealf(cplx[i])));
+      }
+    }
+    // Complex: one rounding of a coefficient up to 1 (FLT_EPSILON / 2)
+    if (worstReal != 0 || worstComplex > FLT_EPSILON) ok = false;
+    printf("%-17s %12.3g %12.3g\n", names[type], worstReal, worstComplex);
+  }
+  printf("%s\n", ok ? "OK: the tables are the coefficients of window()" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -21,11 +21,20 @@ SSD1306 display(0x3c, 21, 22); // 0.96" OLED display (address, SDA, SCL)
 
 unsigned long chrono, chrono2;
 unsigned long sampling_period_us;
-float complex data[SAMPLES];
+float complex data[SAMPLES / 2]; // FFT bins of the real FFT
 int LOG2SAMPLE = log(SAMPLES) / log(2);
 const char filename[] = "/Data.txt";
+const char binFilename[] = "/Data.bin";
 #define BUTTON 19
 #define LEDPIN 2
+#include "fft.h"
+#include "dataset.h"
+#include "recorder.h"
+#include "specview.h"
+#include "oled_flush.h"
+recorder rec;  // /Data.txt, kept open
+dataset_writer binData; // /Data.bin, open during an acquisition
+oled_flush oled; // display sent in the background
 #include "functions.h"
 
 void setup() {
@@ -34,6 +43,7 @@ void setup() {
   // ADC1 Channel 7 is GPIO 35 (microphone)
   adc1_config_channel_atten(ADC1_CHANNEL_7, ADC_ATTEN_DB_11);
   sampling_period_us = round(1000ul * (1.0 / MAX_FREQ));
+  rfft_init(LOG2SAMPLE);
   Serial.println("\nSOUND ACQUISITION\n");
   pinMode (BUTTON, INPUT_PULLUP);  // button on 19
   pinMode (LEDPIN, OUTPUT);
@@ -42,6 +52,9 @@ void setup() {
     return;
   }
   display.init();
+  // The display is sent in the background, by the service only
+  oled_begin(&oled, 0x3c, display.width(), display.height(), DISPLAY_PERIOD);
+  initSpectrumView();
   //  display.flipScreenVertically(); // Adjust to suit or remove
   init(filename);
 }
@@ -58,15 +71,15 @@ void loop() {
   sprintf(text,"(%d)",N);
   display.setTextAlignment(TEXT_ALIGN_RIGHT);
   display.drawString(128, 52, text);
-  display.display();
+  oled_show(&oled, display.buffer);
 
   // Push the button to acquire samples
   while (digitalRead(BUTTON)) yield();
     delay(30); // debounce
-    // Acquire 10 snore samples
+    // Acquire snore spectra
     acquisition(1);
     delay(3000);
-    // Acquire 10 silence samples
+    // Acquire silence spectra
     acquisition(0);
   ++N;
 }
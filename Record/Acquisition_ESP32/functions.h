@@ -1,48 +1,49 @@
-typedef enum fft_dir {
-  FFT_FORWARD,    /* kernel uses "-1" sign */
-  FFT_INVERSE     /* kernel uses "+1" sign */
-} fft_dir;
+// Weighting factor of sample i in a window of N samples
+double window_coef (unsigned int i, unsigned int N, byte windowType) {
+  if (i >= N / 2) i = N - (i + 1); // the windows are symmetric
+  double indexMinusOne = double(i);
+  double ratio = (indexMinusOne / (N - 1));
+  double weighingFactor = 1.0;
+  switch (windowType) {
+    case RECTANGLE: // rectangle (box car)
+      weighingFactor = 1.0;
+      break;
+    case HAMMING: // hamming
+      weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
+      break;
+    case HANN: // hann
+      weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
+      break;
+    case TRIANGLE: // triangle (Bartlett)
+      weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
+      break;
+    case NUTTALL: // nuttall
+      weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN: // blackman
+      weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
+      break;
+    case BLACKMAN_NUTTALL: // blackman nuttall
+      weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN_HARRIS: // blackman harris
+      weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
+      break;
+    case FLT_TOP: // flat top
+      weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
+      break;
+    case WELCH: // welch
+      weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
+      break;
+  }
+  return weighingFactor;
+}
 
 void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir direction) {
   unsigned int N = 1 << log2_N;
   unsigned int Nd2 = N >> 1;
   for (int i = 0; i < Nd2; i++) {
-    double indexMinusOne = double(i);
-    double ratio = (indexMinusOne / (N - 1));
-    double weighingFactor = 1.0;
-    // Compute and record weighting factor
-    switch (windowType) {
-      case RECTANGLE: // rectangle (box car)
-        weighingFactor = 1.0;
-        break;
-      case HAMMING: // hamming
-        weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
-        break;
-      case HANN: // hann
-        weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
-        break;
-      case TRIANGLE: // triangle (Bartlett)
-        weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
-        break;
-      case NUTTALL: // nuttall
-        weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN: // blackman
-        weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
-        break;
-      case BLACKMAN_NUTTALL: // blackman nuttall
-        weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN_HARRIS: // blackman harris
-        weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
-        break;
-      case FLT_TOP: // flat top
-        weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
-        break;
-      case WELCH: // welch
-        weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
-        break;
-    }
+    double weighingFactor = window_coef(i, N, windowType);
     if (direction == FFT_FORWARD) {
       data[i] *= weighingFactor;
       data[N - (i + 1)] *= weighingFactor;
@@ -54,121 +55,46 @@ void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir
   }
 }
 
-void ffti_shuffle_f(float complex *data, unsigned int log2_N)
-{
-  /*
-     Basic Bit-Reversal Scheme:
-
-     The incrementing pattern operations used here correspond
-     to the logic operations of a synchronous counter.
-
-     Incrementing a binary number simply flips a sequence of
-     least-significant bits, for example from 0111 to 1000.
-     So in order to compute the next bit-reversed index, we
-     have to flip a sequence of most-significant bits.
-  */
-
-  unsigned int N = 1 << log2_N;   /* N */
-  unsigned int Nd2 = N >> 1;      /* N/2 = number range midpoint */
-  unsigned int Nm1 = N - 1;       /* N-1 = digit mask */
-  unsigned int i;                 /* index for array elements */
-  unsigned int j;                 /* index for next element swap location */
-
-  for (i = 0, j = 0; i < N; i++) {
-    if (j > i) {
-      float complex tmp = data[i];
-      data[i] = data[j];
-      data[j] = tmp;
+// Same for N real samples
+void window (float *data, unsigned int log2_N, byte windowType, fft_dir direction) {
+  unsigned int N = 1 << log2_N;
+  unsigned int Nd2 = N >> 1;
+  for (int i = 0; i < Nd2; i++) {
+    float weighingFactor = window_coef(i, N, windowType);
+    if (direction == FFT_FORWARD) {
+      data[i] *= weighingFactor;
+      data[N - (i + 1)] *= weighingFactor;
+    }
+    else {
+      data[i] /= weighingFactor;
+      data[N - (i + 1)] /= weighingFactor;
     }
-
-    /*
-       Find least significant zero bit
-    */
-
-    unsigned int lszb = ~i & (i + 1);
-
-    /*
-       Use division to bit-reverse the single bit so that we now have
-       the most significant zero bit
-
-       N = 2^r = 2^(m+1)
-       Nd2 = N/2 = 2^m
-       if lszb = 2^k, where k is within the range of 0...m, then
-           mszb = Nd2 / lszb
-                = 2^m / 2^k
-                = 2^(m-k)
-                = bit-reversed value of lszb
-    */
-
-    unsigned int mszb = Nd2 / lszb;
-
-    /*
-       Toggle bits with bit-reverse mask
-    */
-
-    unsigned int bits = Nm1 & ~(mszb - 1);
-    j ^= bits;
   }
 }
 
+// Window coefficient tables, one per (window type, size), built on first use
+static float* windowTables[WINDOW_TYPES][FFT_MAX_LOG2 + 1] = {{NULL}};
 
-
-void ffti_evaluate_f(float complex *data, unsigned int log2_N, fft_dir direction)
-{
-  /*
-     In-place FFT butterfly algorithm
-
-     input:
-         A[] = array of N shuffled complex values where N is a power of 2
-     output:
-         A[] = the DFT of input A[]
-
-     for r = 1 to log2(N)
-         m = 2^r
-         Wm = exp(−j2π/m)
-         for n = 0 to N-1 by m
-             Wmk = 1
-             for k = 0 to m/2 - 1
-                 u = A[n + k]
-                 t = Wmk * A[n + k + m/2]
-                 A[n + k]       = u + t
-                 A[n + k + m/2] = u - t
-                 Wmk = Wmk * Wm
-
-     For inverse FFT, use Wm = exp(+j2π/m)
-  */
-
-  unsigned int N = 1 << log2_N;
-  double theta_2pi = (direction == FFT_FORWARD) ? -PI : PI;
-  theta_2pi *= 2;
-
-  for (unsigned int r = 1; r <= log2_N; r++)
-  {
-    unsigned int m = 1 << r;
-    unsigned int md2 = m >> 1;
-    double theta = theta_2pi / m;
-    double re = cos(theta);
-    double im = sin(theta);
-    double complex Wm = re + I * im;
-    for (unsigned int n = 0; n < N; n += m) {
-      double complex Wmk = 1.0f;   /* Use double for precision */
-      for (unsigned int k = 0; k < md2; k++) {
-        unsigned int i_e = n + k;
-        unsigned int i_o = i_e + md2;
-        double complex t = Wmk * data[i_o];
-        data[i_o] = data[i_e] - t;
-        data[i_e] = data[i_e] + t;
-        t = Wmk * Wm;
-        Wmk = t;
-      }
-    }
+// Returns the N = 2^log2_N coefficients of a window (the reference
+// window() above computes the same values at each call)
+const float* window_table (byte windowType, unsigned int log2_N) {
+  if (windowType >= WINDOW_TYPES || log2_N > FFT_MAX_LOG2) return NULL;
+  if (windowTables[windowType][log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;
+    float* table = (float*) malloc(N * sizeof(float));
+    if (table == NULL) return NULL;
+    for (unsigned int i = 0; i < N; i++) table[i] = window_coef(i, N, windowType);
+    windowTables[windowType][log2_N] = table;
   }
+  return windowTables[windowType][log2_N];
 }
 
-void ffti_f(float complex data[], unsigned int log2_N, fft_dir direction)
-{
-  ffti_shuffle_f(data, log2_N);
-  ffti_evaluate_f(data, log2_N, direction);
+// Windows N real samples with the cached coefficients
+void window_apply (float *data, unsigned int log2_N, byte windowType) {
+  const float* coef = window_table(windowType, log2_N);
+  if (coef == NULL) return;
+  unsigned int N = 1 << log2_N;
+  for (unsigned int i = 0; i < N; i++) data[i] *= coef[i];
 }
 
 int mean(int i1, int i2) {
@@ -178,47 +104,63 @@ int mean(int i1, int i2) {
   return (int)sum;
 }
 
-int acquireAmplitude () {
-  unsigned int signalMax = 0;
-  unsigned int signalMin = 4096;
-  unsigned long chrono = micros(); // Sample window 1 ms
-  while (micros() - chrono < 1000ul) {
-    int sample = analogRead(35);
-    if (sample > signalMax) signalMax = sample;
-    else if (sample < signalMin) signalMin = sample;
-  }
-  unsigned int peakToPeak = signalMax - signalMin;
-  int amplitude = peakToPeak - 70;
-  constrain(amplitude, 0, 500);
-  return amplitude;
-}
+// Amplitude: peak to peak of the first ms of the frame (MAX_FREQ
+// samples), taken while sampling instead of in a separate 1 ms loop
+int amplitude = 0;
 
 void acquireSound () {
+  float *samples = (float *) data; // real samples, then FFT bins
+  const uint16_t *slot = rfft_slots(LOG2SAMPLE); // bit-reversed order
+  const float *coef = window_table(HAMMING, LOG2SAMPLE);
+  int signalMax = 0;
+  int signalMin = 4096;
   digitalWrite(LEDPIN, HIGH);
   for (int i = 0; i < SAMPLES; i++) {
     unsigned long chrono = micros();
-    data[i] = analogRead(35);
+    int sample = analogRead(35);
+    if (i < MAX_FREQ) {
+      if (sample > signalMax) signalMax = sample;
+      if (sample < signalMin) signalMin = sample;
+    }
+    // Windowed sample, straight into its FFT input slot
+    samples[slot[i]] = sample * coef[i];
     while (micros() - chrono < sampling_period_us); // do nothing
   }
   digitalWrite(LEDPIN, LOW);
-  window (data, LOG2SAMPLE, HAMMING, FFT_FORWARD);
-  ffti_f(data, LOG2SAMPLE, FFT_FORWARD);
+  amplitude = signalMax - signalMin - 70;
+  amplitude = constrain(amplitude, 0, 500); // as the input of the network
+  rfft_evaluate_f(samples, LOG2SAMPLE);
+}
+
+// Spectrum view: the bars are updated in place under the frequency
+// labels, which are drawn only after a full redraw
+const uint16_t spectrumColors[1] = {WHITE};
+specview spectrumView;
+
+void oledFill (int x, int y, int w, int h, uint16_t color) {
+  display.setColor((OLEDDISPLAY_COLOR) color);
+  display.fillRect(x, y, w, h);
+}
+
+void initSpectrumView () {
+  const int labels = 13; // height of the labels
+  specview_init(&spectrumView, 0, display.height(), display.width(), display.height() - labels,
+                oledFill, BLACK, WHITE, spectrumColors, 1, 0);
 }
 
 void displaySpectrum () {
-  int nFreq = display.width();
-  int hauteur = display.height();
-  display.clear();
-  display.setTextAlignment(TEXT_ALIGN_CENTER);
-  float freqs[10] = {.5, 1, 2, 3, 4, 6, 8, 10, 12, 15};
-  float FREQmax = MAX_FREQ * 128.0 / SAMPLES;
-  for (int i = 0; i < 10; i++) {
-    int pos =  FREQ2IND * freqs[i] ;
-    if (pos > display.width() + 1) break;
-    if (i == 0)display.drawString(pos, 0, ".5");
-    else display.drawString(pos, 0, String(freqs[i], 0));
+  int nFreq = min(display.width(), SAMPLES / 2);
+  if (specview_begin(&spectrumView, false)) {
+    display.clear();
+    display.setTextAlignment(TEXT_ALIGN_CENTER);
+    float freqs[10] = {.5, 1, 2, 3, 4, 6, 8, 10, 12, 15};
+    for (int i = 0; i < 10; i++) {
+      int pos =  FREQ2IND * freqs[i] ;
+      if (pos > display.width() + 1) break;
+      if (i == 0)display.drawString(pos, 0, ".5");
+      else display.drawString(pos, 0, String(freqs[i], 0));
+    }
   }
-  display.setTextAlignment(TEXT_ALIGN_LEFT);
 
   // Affichage du spectre
   int ampmax = 0;
@@ -229,39 +171,48 @@ void displaySpectrum () {
       ampmax = amplitude;
       imax = i;
     }
-    amplitude = min(amplitude, hauteur);
-    display.drawVerticalLine (i, hauteur - amplitude, amplitude);
+    specview_bar(&spectrumView, i, 1, amplitude, -1);
   }
 
-  // Affichage fréquence de plus forte amplitude
+  // Affichage fréquence de plus forte amplitude, effacée par les barres
+  static int textX = 0, textW = 0;
+  specview_repaint(&spectrumView, textX, 20, textW, 13);
   int freqmax = 985.0 * imax * MAX_FREQ / SAMPLES;
   char texte[14];
   sprintf(texte, "%4d Hz: %d", freqmax, ampmax);
+  display.setColor(WHITE);
   display.setTextAlignment(TEXT_ALIGN_RIGHT);
   display.drawString(128, 20, texte);
-  display.display();
+  textW = display.getStringWidth(texte);
+  textX = 128 - textW;
+  oled_present(&oled, display.buffer);
 }
 
-void saveSpectrum (const char * path, int val) {
-  File file = SPIFFS.open(path, FILE_APPEND);
-  if (!file) {
-    Serial.println("--> failed to open file for appending");
-    return;
-  }
+// Appends a row to the dataset, through the recorder (file kept open)
+void saveSpectrum (int val) {
+  uint16_t features[BANDS + 1]; // bands, then amplitude
   int nFreqs = SAMPLES / BANDS / 2;
   for (int i = 0; i < BANDS; i++) {
     int ind1 = i * nFreqs;
     int ind2 = ind1 + nFreqs;
     if (ind1 == 0) ind1 = 3;
-    file.printf("%d ", mean(ind1, ind2));
-    Serial.printf("%2d ", mean(ind1, ind2));
+    int m = mean(ind1, ind2);
+    rec_printf(&rec, "%d ", m);
+#if SERIAL_ECHO
+    Serial.printf("%2d ", m);
+#endif
+    features[i] = constrain(m, 0, 65535);
   }
-  int amp = acquireAmplitude ();
-  file.printf("%d ", amp);
-  Serial.printf("%d ", amp);
-  file.println(val);
-  Serial.println(val);
-  file.close();
+  rec_printf(&rec, "%d %d\r\n", amplitude, val);
+  rec_row(&rec);
+#if SERIAL_ECHO
+  Serial.printf("%d %d\n", amplitude, val);
+#endif
+  features[BANDS] = constrain(amplitude, 0, 65535);
+#if DATASET_BIN
+  if (!dataset_append(&binData, features, val))
+    Serial.println("--> failed to append to the binary dataset");
+#endif
 }
 
 void init (const char * path) {
@@ -269,13 +220,13 @@ void init (const char * path) {
   display.setTextAlignment(TEXT_ALIGN_CENTER);
   display.drawString(64, 5, "SPECTRUM"); // Splash screen
   display.drawString(64, 35, "ACQUISITION");
-  display.display();
+  oled_show(&oled, display.buffer);
   delay(1500);
   display.setFont(ArialMT_Plain_10);
   display.clear();
   display.drawString(64, 5, "PUSH BUTTON TO");
   display.drawString(64, 25, "ERASE FILE");
-  display.display();
+  oled_show(&oled, display.buffer);
   chrono = millis();
   bool erase = false;
   while (millis() - chrono < 3000ul) {
@@ -290,12 +241,17 @@ void init (const char * path) {
     file.println(BANDS);
     display.drawString(64, 45, "--> FILE ERASED <--");
   } else display.drawString(64, 45, "--> FILE SAVED <--");
-  display.display();
+#if DATASET_BIN
+  if (erase || !SPIFFS.exists(binFilename)) dataset_create(binFilename, BANDS + 1);
+#endif
+  if (!rec_open(&rec, path, REC_BLOCK, REC_SYNC_MS))
+    Serial.println("--> failed to open file for appending");
+  oled_show(&oled, display.buffer);
   delay(1500);
 }
 
 void acquisition (int soundType) {
-  // Acquire 10 samples: snore if soundType = 1, silence if 0
+  // Acquire spectra during RECORD_TIME: snore if soundType = 1, silence if 0
   display.clear();
   display.setTextAlignment(TEXT_ALIGN_CENTER);
   if (soundType == 1)
@@ -305,23 +261,41 @@ void acquisition (int soundType) {
   display.drawString(64, 20, "FOR 3 SECONDS");
   display.setFont(ArialMT_Plain_16);
   display.drawString(64, 40, "...");
-  display.display();
+  oled_show(&oled, display.buffer);
   delay(1500);
   display.drawString(64, 40, "NOW");
-  display.display();
+  oled_show(&oled, display.buffer);
   delay(700);
   display.setFont(ArialMT_Plain_10);
+  specview_invalidate(&spectrumView); // full redraw at the first spectrum
+#if DATASET_BIN
+  if (!dataset_begin(&binData, binFilename))
+    Serial.println("--> failed to open the binary dataset");
+#endif
+  // Spectrum acquisitions during RECORD_TIME, one every FRAME_PERIOD
   int count = 0;
-  while (count < 10) {  // 10 spectrum acquisitions in 2 seconds
-    if (soundType == 1)
-      Serial.printf("Snore sound number %d\n", count + 1);
-    else
-      Serial.printf("Silence number %d\n", count + 1);
+  unsigned long waits = rec.waits, errors = rec.errors;
+  unsigned long start = millis();
+  unsigned long lastDisplay = 0;
+  while (millis() - start < RECORD_TIME) {
     chrono2 = millis();
     acquireSound();
-    displaySpectrum();
-    saveSpectrum(filename, soundType); // '1' is for snore sound
-    while (millis() - chrono2 < 200ul) yield(); // wait 200 ms
+    if (chrono2 - lastDisplay >= DISPLAY_PERIOD) {
+      displaySpectrum();
+      lastDisplay = chrono2;
+    }
+    saveSpectrum(soundType); // '1' is for snore sound
     ++count;
+    while (millis() - chrono2 < FRAME_PERIOD) yield();
   }
+#if DATASET_BIN
+  // Row count of the binary dataset, once for the acquisition
+  if (!dataset_end(&binData))
+    Serial.println("--> failed to close the binary dataset");
+#endif
+  // Rows of the acquisition written to /Data.txt, whatever REC_SYNC_MS
+  errors = rec_sync(&rec) - errors;
+  Serial.printf("%s: %d spectra in %lu ms (%lu waits for the flash)\n",
+                (soundType == 1) ? "Snore" : "Silence", count, RECORD_TIME, rec.waits - waits);
+  if (errors > 0) Serial.printf("--> %lu errors writing the file (failed or truncated writes)\n", errors);
 }
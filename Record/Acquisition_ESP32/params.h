@@ -9,6 +9,7 @@
 #define BLACKMAN_HARRIS 0x07 /* blackman harris*/
 #define FLT_TOP 0x08 /* flat top */
 #define WELCH 0x09 /* welch */
+#define WINDOW_TYPES 10 /* number of window types */
 
 // FFT parameters
 #define SAMPLES 256
@@ -17,3 +18,11 @@
 #define COEF 20
 // Frequency bands
 #define BANDS 32
+// Also save the spectra in the binary dataset /Data.bin (dataset.h)
+#define DATASET_BIN 0
+// Recording
+#define RECORD_TIME 2000ul   // ms of snore or silence per acquisition
+#define FRAME_PERIOD 0ul     // ms between two recorded spectra (0: full frame rate)
+#define DISPLAY_PERIOD 100ul // ms between two spectrum displays
+#define REC_SYNC_MS 1000ul   // rows written to flash at least every REC_SYNC_MS ms (0: by blocks)
+#define SERIAL_ECHO 0        // print each row on Serial (slows the recording down)
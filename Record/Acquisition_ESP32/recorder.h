@@ -0,0 +1,232 @@
+/*
+   Buffered recording file
+
+   The file stays open while recording. The rows are formatted straight
+   into a RAM block, and a background task (std::thread on the host)
+   writes the full blocks while the next one is filled (double
+   buffering): the acquisition loop never waits for the flash, unless it
+   fills a whole block before the previous one is written (counted in
+   waits). The blocks end on multiples of the block size in the file, so
+   the flash is written by whole pages.
+
+   Durability: the rows of the buffers are lost on a reset. With a
+   syncMs period (rec_open), the block being filled is also written
+   once it is syncMs old, so that about syncMs of recording at most is
+   lost (the next block then restarts at the boundary). 0: only full
+   blocks, and at rec_sync / rec_close.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#endif
+
+#define REC_BLOCK 4096  // default block size: 16 SPIFFS pages
+#define REC_LINE 128    // longest text of a rec_printf across two blocks
+
+typedef struct
+{
+  File file;
+  char *buf[2];
+  size_t size;                  // block size
+  int fill;                     // buffer being filled
+  size_t used;                  // bytes in it
+  size_t room;                  // its capacity, up to the next block boundary
+  unsigned long pos;            // file offset of its first byte
+  unsigned long syncMs;         // durability period, 0: none
+  unsigned long started;        // time it was started
+  std::atomic<size_t> pending;  // bytes of the other buffer to write, 0: none
+  std::atomic<bool> running;
+  std::atomic<bool> done;
+  // Statistics
+  unsigned long rows;           // rows recorded
+  unsigned long blocks;         // writes
+  unsigned long waits;          // times the recording waited for the flash
+  volatile unsigned long errors; // failed writes, truncated texts
+#ifndef ARDUINO
+  std::thread *task;
+#endif
+}
+recorder;
+
+static inline unsigned long rec_millis()
+{
+#ifdef ARDUINO
+  return millis();
+#else
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+static inline void rec_idle()
+{
+#ifdef ARDUINO
+  vTaskDelay(1);
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+// Writes the blocks handed over by the recording
+static void rec_run(recorder *r)
+{
+  while (true) {
+    size_t n = r->pending.load(std::memory_order_acquire);
+    if (n == 0) {
+      if (!r->running) break;
+      rec_idle();
+      continue;
+    }
+    const char *out = r->buf[1 - r->fill];
+    if (r->file.write((const uint8_t *) out, n) != n) ++r->errors;
+    r->file.flush();
+    ++r->blocks;
+    r->pending.store(0, std::memory_order_release);
+  }
+  r->done = true;
+}
+
+#ifdef ARDUINO
+static void rec_task(void *param)
+{
+  rec_run((recorder *) param);
+  vTaskDelete(NULL);
+}
+#endif
+
+// Hands the filled buffer over to the task and starts the other one.
+// If the task is still writing, waits (wait = true) or returns false.
+static bool rec_handoff(recorder *r, bool wait)
+{
+  if (r->used == 0) return true;
+  if (r->pending.load(std::memory_order_acquire) != 0) {
+    if (!wait) return false;
+    ++r->waits;
+    while (r->pending.load(std::memory_order_acquire) != 0) rec_idle();
+  }
+  const size_t n = r->used;
+  r->fill = 1 - r->fill;
+  r->pos += n;
+  r->used = 0;
+  r->room = r->size - r->pos % r->size;
+  r->started = rec_millis();
+  r->pending.store(n, std::memory_order_release);
+  return true;
+}
+
+// Opens a file to append rows, with blocks of blockSize bytes
+bool rec_open(recorder *r, const char *path, size_t blockSize, unsigned long syncMs)
+{
+  r->file = SPIFFS.open(path, FILE_APPEND);
+  if (!r->file) return false;
+  r->buf[0] = (char *) malloc(blockSize);
+  r->buf[1] = (char *) malloc(blockSize);
+  if (r->buf[0] == NULL || r->buf[1] == NULL) {
+    free(r->buf[0]);
+    free(r->buf[1]);
+    r->file.close();
+    return false;
+  }
+  r->size = blockSize;
+  r->fill = 0;
+  r->used = 0;
+  r->pos = r->file.size();
+  r->room = r->size - r->pos % r->size;
+  r->syncMs = syncMs;
+  r->started = rec_millis();
+  r->rows = r->blocks = r->waits = r->errors = 0;
+  r->pending = 0;
+  r->done = false;
+  r->running = true;
+#ifdef ARDUINO
+  // Core 0, the acquisition runs on core 1
+  if (xTaskCreatePinnedToCore(rec_task, "recorder", 4096, r, 1, NULL, 0) != pdPASS) {
+    r->running = false;
+    return false;
+  }
+#else
+  r->task = new std::thread(rec_run, r);
+#endif
+  return true;
+}
+
+// Appends bytes
+void rec_write(recorder *r, const void *data, size_t n)
+{
+  const char *p = (const char *) data;
+  while (n > 0) {
+    size_t k = (n < r->room - r->used) ? n : r->room - r->used;
+    memcpy(r->buf[r->fill] + r->used, p, k);
+    r->used += k;
+    p += k;
+    n -= k;
+    if (r->used == r->room) rec_handoff(r, true);
+  }
+}
+
+// Appends formatted text, formatted in place when it fits in the block.
+// Across two blocks, a text longer than REC_LINE - 1 is truncated (counted
+// in errors). Returns the length of the whole text, as printf.
+int rec_printf(recorder *r, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  const size_t avail = r->room - r->used;
+  int n = vsnprintf(r->buf[r->fill] + r->used, avail, format, args);
+  va_end(args);
+  if (n < 0) return n;
+  if ((size_t) n < avail) {
+    r->used += n;
+    return n;
+  }
+  // Across two blocks
+  char line[REC_LINE];
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if ((size_t) n < sizeof(line)) rec_write(r, line, n);
+  else {
+    rec_write(r, line, sizeof(line) - 1);
+    ++r->errors;
+  }
+  return n;
+}
+
+// Ends a row: applies the durability period (without waiting, the
+// rows are written at the next row if the task is busy)
+void rec_row(recorder *r)
+{
+  ++r->rows;
+  if (r->syncMs > 0 && rec_millis() - r->started >= r->syncMs) rec_handoff(r, false);
+}
+
+// Writes all the rows recorded so far, and waits until they are written.
+// Returns the errors since the open (failed writes, truncated texts).
+unsigned long rec_sync(recorder *r)
+{
+  rec_handoff(r, true);
+  while (r->pending.load(std::memory_order_acquire) != 0) rec_idle();
+  return r->errors;
+}
+
+// Writes all the rows, stops the task and closes the file. Returns the
+// errors of the recording, as rec_sync.
+unsigned long rec_close(recorder *r)
+{
+  const unsigned long errors = rec_sync(r);
+  r->running = false;
+  while (!r->done) rec_idle();
+#ifndef ARDUINO
+  r->task->join();
+  delete r->task;
+#endif
+  r->file.close();
+  free(r->buf[0]);
+  free(r->buf[1]);
+  return errors;
+}
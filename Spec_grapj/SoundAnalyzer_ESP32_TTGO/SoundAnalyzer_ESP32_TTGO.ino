@@ -18,11 +18,14 @@ SSD1306 display(0x3c, 21, 22); // Invoke custom library
 unsigned long chrono, chrono1;
 unsigned long sampling_period_us;
 byte peak[SAMPLES] = {0};
-float complex data[SAMPLES];
+float complex data[SAMPLES / 2]; // FFT bins of the real FFT
 int sound[SAMPLES];
 float MULT = MAX_FREQ * 1000.0 / SAMPLES;
 unsigned int P2P = 0;
 int LOG2SAMPLE = log(SAMPLES) / log(2);
+#include "fft.h"
+#include "specview.h"
+#include "runplot.h"
 #include "functions.h"
 #define MODE 19
 #define MAXMODES 5
@@ -48,6 +51,8 @@ void setup() {
   display.drawString("[by Lesept]", 165, 120, 2);
   delay(2000);
   sampling_period_us = round(1000ul * (1.0 / MAX_FREQ));
+  rfft_init(LOG2SAMPLE);
+  initSpectrumViews();
   chrono1 = millis();
 }
 
@@ -67,11 +72,11 @@ void loop() {
   switch (modes) {
     case 0: // Display spectrum
       acquireSound();
-      displaySpectrum();
+      displaySpectrum(changeMode);
       break;
     case 1: // Display spectrum
       acquireSound();
-      displaySpectrum2();
+      displaySpectrum2(changeMode);
       break;
     case 2: // Display amplitude with bars
       displayAmplitudeBars();
@@ -1,48 +1,49 @@
-typedef enum fft_dir {
-  FFT_FORWARD,    /* kernel uses "-1" sign */
-  FFT_INVERSE     /* kernel uses "+1" sign */
-} fft_dir;
+// Weighting factor of sample i in a window of N samples
+double window_coef (unsigned int i, unsigned int N, byte windowType) {
+  if (i >= N / 2) i = N - (i + 1); // the windows are symmetric
+  double indexMinusOne = double(i);
+  double ratio = (indexMinusOne / (N - 1));
+  double weighingFactor = 1.0;
+  switch (windowType) {
+    case RECTANGLE: // rectangle (box car)
+      weighingFactor = 1.0;
+      break;
+    case HAMMING: // hamming
+      weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
+      break;
+    case HANN: // hann
+      weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
+      break;
+    case TRIANGLE: // triangle (Bartlett)
+      weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
+      break;
+    case NUTTALL: // nuttall
+      weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN: // blackman
+      weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
+      break;
+    case BLACKMAN_NUTTALL: // blackman nuttall
+      weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
+      break;
+    case BLACKMAN_HARRIS: // blackman harris
+      weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
+      break;
+    case FLT_TOP: // flat top
+      weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
+      break;
+    case WELCH: // welch
+      weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
+      break;
+  }
+  return weighingFactor;
+}
 
 void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir direction) {
   unsigned int N = 1 << log2_N;
   unsigned int Nd2 = N >> 1;
   for (int i = 0; i < Nd2; i++) {
-    double indexMinusOne = double(i);
-    double ratio = (indexMinusOne / (N - 1));
-    double weighingFactor = 1.0;
-    // Compute and record weighting factor
-    switch (windowType) {
-      case RECTANGLE: // rectangle (box car)
-        weighingFactor = 1.0;
-        break;
-      case HAMMING: // hamming
-        weighingFactor = 0.54 - (0.46 * cos(2 * PI * ratio));
-        break;
-      case HANN: // hann
-        weighingFactor = 0.54 * (1.0 - cos(2 * PI * ratio));
-        break;
-      case TRIANGLE: // triangle (Bartlett)
-        weighingFactor = 1.0 - ((2.0 * abs(indexMinusOne - ((N - 1) / 2.0))) / (N - 1));
-        break;
-      case NUTTALL: // nuttall
-        weighingFactor = 0.355768 - (0.487396 * (cos(2 * PI * ratio))) + (0.144232 * (cos(4 * PI * ratio))) - (0.012604 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN: // blackman
-        weighingFactor = 0.42323 - (0.49755 * (cos(2 * PI * ratio))) + (0.07922 * (cos(4 * PI * ratio)));
-        break;
-      case BLACKMAN_NUTTALL: // blackman nuttall
-        weighingFactor = 0.3635819 - (0.4891775 * (cos(2 * PI * ratio))) + (0.1365995 * (cos(4 * PI * ratio))) - (0.0106411 * (cos(6 * PI * ratio)));
-        break;
-      case BLACKMAN_HARRIS: // blackman harris
-        weighingFactor = 0.35875 - (0.48829 * (cos(2 * PI * ratio))) + (0.14128 * (cos(4 * PI * ratio))) - (0.01168 * (cos(6 * PI * ratio)));
-        break;
-      case FLT_TOP: // flat top
-        weighingFactor = 0.2810639 - (0.5208972 * cos(2 * PI * ratio)) + (0.1980399 * cos(4 * PI * ratio));
-        break;
-      case WELCH: // welch
-        weighingFactor = 1.0 - sq((indexMinusOne - (N - 1) / 2.0) / ((N - 1) / 2.0));
-        break;
-    }
+    double weighingFactor = window_coef(i, N, windowType);
     if (direction == FFT_FORWARD) {
       data[i] *= weighingFactor;
       data[N - (i + 1)] *= weighingFactor;
@@ -54,121 +55,46 @@ void window (float complex *data, unsigned int log2_N, byte windowType, fft_dir
   }
 }
 
-void ffti_shuffle_f(float complex *data, unsigned int log2_N)
-{
-  /*
-     Basic Bit-Reversal Scheme:
-
-     The incrementing pattern operations used here correspond
-     to the logic operations of a synchronous counter.
-
-     Incrementing a binary number simply flips a sequence of
-     least-significant bits, for example from 0111 to 1000.
-     So in order to compute the next bit-reversed index, we
-     have to flip a sequence of most-significant bits.
-  */
-
-  unsigned int N = 1 << log2_N;   /* N */
-  unsigned int Nd2 = N >> 1;      /* N/2 = number range midpoint */
-  unsigned int Nm1 = N - 1;       /* N-1 = digit mask */
-  unsigned int i;                 /* index for array elements */
-  unsigned int j;                 /* index for next element swap location */
-
-  for (i = 0, j = 0; i < N; i++) {
-    if (j > i) {
-      float complex tmp = data[i];
-      data[i] = data[j];
-      data[j] = tmp;
+// Same for N real samples
+void window (float *data, unsigned int log2_N, byte windowType, fft_dir direction) {
+  unsigned int N = 1 << log2_N;
+  unsigned int Nd2 = N >> 1;
+  for (int i = 0; i < Nd2; i++) {
+    float weighingFactor = window_coef(i, N, windowType);
+    if (direction == FFT_FORWARD) {
+      data[i] *= weighingFactor;
+      data[N - (i + 1)] *= weighingFactor;
+    }
+    else {
+      data[i] /= weighingFactor;
+      data[N - (i + 1)] /= weighingFactor;
     }
-
-    /*
-       Find least significant zero bit
-    */
-
-    unsigned int lszb = ~i & (i + 1);
-
-    /*
-       Use division to bit-reverse the single bit so that we now have
-       the most significant zero bit
-
-       N = 2^r = 2^(m+1)
-       Nd2 = N/2 = 2^m
-       if lszb = 2^k, where k is within the range of 0...m, then
-           mszb = Nd2 / lszb
-                = 2^m / 2^k
-                = 2^(m-k)
-                = bit-reversed value of lszb
-    */
-
-    unsigned int mszb = Nd2 / lszb;
-
-    /*
-       Toggle bits with bit-reverse mask
-    */
-
-    unsigned int bits = Nm1 & ~(mszb - 1);
-    j ^= bits;
   }
 }
 
-
-
-void ffti_evaluate_f(float complex *data, unsigned int log2_N, fft_dir direction)
-{
-  /*
-     In-place FFT butterfly algorithm
-
-     input:
-         A[] = array of N shuffled complex values where N is a power of 2
-     output:
-         A[] = the DFT of input A[]
-
-     for r = 1 to log2(N)
-         m = 2^r
-         Wm = exp(−j2π/m)
-         for n = 0 to N-1 by m
-             Wmk = 1
-             for k = 0 to m/2 - 1
-                 u = A[n + k]
-                 t = Wmk * A[n + k + m/2]
-                 A[n + k]       = u + t
-                 A[n + k + m/2] = u - t
-                 Wmk = Wmk * Wm
-
-     For inverse FFT, use Wm = exp(+j2π/m)
-  */
-
-  unsigned int N = 1 << log2_N;
-  double theta_2pi = (direction == FFT_FORWARD) ? -PI : PI;
-  theta_2pi *= 2;
-
-  for (unsigned int r = 1; r <= log2_N; r++)
-  {
-    unsigned int m = 1 << r;
-    unsigned int md2 = m >> 1;
-    double theta = theta_2pi / m;
-    double re = cos(theta);
-    double im = sin(theta);
-    double complex Wm = re + I * im;
-    for (unsigned int n = 0; n < N; n += m) {
-      double complex Wmk = 1.0f;   /* Use double for precision */
-      for (unsigned int k = 0; k < md2; k++) {
-        unsigned int i_e = n + k;
-        unsigned int i_o = i_e + md2;
-        double complex t = Wmk * data[i_o];
-        data[i_o] = data[i_e] - t;
-        data[i_e] = data[i_e] + t;
-        t = Wmk * Wm;
-        Wmk = t;
-      }
-    }
+// Window coefficient tables, one per (window type, size), built on first use
+static float* windowTables[WINDOW_TYPES][FFT_MAX_LOG2 + 1] = {{NULL}};
+
+// Returns the N = 2^log2_N coefficients of a window (the reference
+// window() above computes the same values at each call)
+const float* window_table (byte windowType, unsigned int log2_N) {
+  if (windowType >= WINDOW_TYPES || log2_N > FFT_MAX_LOG2) return NULL;
+  if (windowTables[windowType][log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;
+    float* table = (float*) malloc(N * sizeof(float));
+    if (table == NULL) return NULL;
+    for (unsigned int i = 0; i < N; i++) table[i] = window_coef(i, N, windowType);
+    windowTables[windowType][log2_N] = table;
   }
+  return windowTables[windowType][log2_N];
 }
 
-void ffti_f(float complex data[], unsigned int log2_N, fft_dir direction)
-{
-  ffti_shuffle_f(data, log2_N);
-  ffti_evaluate_f(data, log2_N, direction);
+// Windows N real samples with the cached coefficients
+void window_apply (float *data, unsigned int log2_N, byte windowType) {
+  const float* coef = window_table(windowType, log2_N);
+  if (coef == NULL) return;
+  unsigned int N = 1 << log2_N;
+  for (unsigned int i = 0; i < N; i++) data[i] *= coef[i];
 }
 
 int mean(int i1, int i2) {
@@ -179,54 +105,59 @@ int mean(int i1, int i2) {
 }
 
 void acquireSound () {
+  float *samples = (float *) data; // real samples, then FFT bins
   for (int i = 0; i < SAMPLES; i++) {
     unsigned long chrono = micros();
-    data[i] = analogRead(MIC);
+    samples[i] = analogRead(MIC);
     while (micros() - chrono < sampling_period_us); // do nothing
   }
 }
 
-void displaySpectrum () {
-  window (data, LOG2SAMPLE, HAMMING, FFT_FORWARD);
-  ffti_f(data, LOG2SAMPLE, FFT_FORWARD);
+// Spectrum views: the bars are updated in place, the labels below the
+// plot are drawn only after a full redraw
+const uint16_t spectrumColors[1] = {TFT_GREEN};
+const uint16_t barColors[8] = {TFT_DARKGREEN, TFT_GREEN, TFT_GREENYELLOW, TFT_YELLOW,
+                               TFT_GOLD, TFT_ORANGE, TFT_RED, TFT_BROWN
+                              };
+specview spectrumView, spectrumView2;
+
+void tftFill (int x, int y, int w, int h, uint16_t color) {
+  display.fillRect(x, y, w, h, color);
+}
+
+void initSpectrumViews () {
+  const int decal = 15;
+  const int hauteur = display.height() - decal;
+  specview_init(&spectrumView, 0, hauteur, display.width(), hauteur, tftFill,
+                TFT_BLACK, TFT_RED, spectrumColors, 1, 0);
+  // 7 levels of colors
+  const int dh = hauteur / 8;
+  specview_init(&spectrumView2, 0, hauteur, display.width(), hauteur, tftFill,
+                TFT_BLACK, TFT_BLACK, barColors, 7, dh);
+}
+
+void displaySpectrum (bool erase) {
+  window_apply((float *) data, LOG2SAMPLE, HAMMING);
+  rfft_f((float *) data, LOG2SAMPLE);
   int nFreq = SAMPLES / 2;
   int hauteur = display.height();
-  display.fillScreen(TFT_BLACK);
-  display.setTextColor(TFT_WHITE);
-  display.setTextSize(1);
-  const float freqs[7] = {.5, 1, 2, 3, 4, 6, 8};
-  for (int i = 0; i < 7; i++) {
-    int pos =  FREQ2IND * freqs[i] * 1.9 ;
-    if (i == 0) display.drawString(".5", pos - 5, hauteur - 13, 2);
-    else display.drawString(String(freqs[i], 0), pos, hauteur - 13, 2);
-  }
-  display.drawString("kHz", display.width() - 22, hauteur - 13, 2);
-
   int decal = 15;
-  // Affichage du spectre
-  int ampmax = 0;
-  int imax = 0;
-  for (int i = 2; i < nFreq; i++) {
-    int amplitude = (int)creal(data[i]) / COEF;
-    if (amplitude > ampmax) {
-      ampmax = amplitude;
-      imax = i;
+  if (specview_begin(&spectrumView, erase)) {
+    display.fillScreen(TFT_BLACK);
+    display.setTextColor(TFT_WHITE);
+    display.setTextSize(1);
+    const float freqs[7] = {.5, 1, 2, 3, 4, 6, 8};
+    for (int i = 0; i < 7; i++) {
+      int pos =  FREQ2IND * freqs[i] * 1.9 ;
+      if (i == 0) display.drawString(".5", pos - 5, hauteur - 13, 2);
+      else display.drawString(String(freqs[i], 0), pos, hauteur - 13, 2);
     }
-    amplitude = min(amplitude, hauteur - decal);
-    display.drawFastVLine (i * 2, hauteur - amplitude - decal, amplitude, TFT_GREEN);
+    display.drawString("kHz", display.width() - 22, hauteur - 13, 2);
   }
 
-  // Affichage fréquence de plus forte amplitude
-  if (ampmax > 20) {
-    display.setTextSize(2);
-    display.setTextColor(TFT_BLUE);
-    int freqmax = 985.0 * imax * MAX_FREQ / SAMPLES;
-    char texte[14];
-    sprintf(texte, "%4d Hz: %3d", freqmax, ampmax);
-    display.drawString(texte, display.width() - 145, 0, 1);
-  }
-
-  // Affichage et décroissance des valeurs peak
+  // Décroissance des valeurs peak (groupes de 4 fréquences)
+  int marker[SAMPLES / 2];
+  for (int i = 0; i < nFreq; i++) marker[i] = -1;
   for (int i = 2; i < nFreq - 4; i = i + 4) {
     int amplitude = (int)creal(data[i]);
     amplitude = max(amplitude, (int)creal(data[i + 1]));
@@ -237,54 +168,67 @@ void displaySpectrum () {
     if (peak[i] > hauteur - decal) peak[i] = hauteur - decal;
     if (peak[i] > 8) {
       peak[i] -= 2; // Decay the peak
-      display.drawFastHLine(i * 2, hauteur - peak[i] - decal, 4, TFT_RED);
+      marker[i] = marker[i + 1] = peak[i] - 1;
     }
   }
-}
 
-void rectangleGR (int x0, int w, int h) {
-  const uint16_t colors[8] = {TFT_DARKGREEN, TFT_GREEN, TFT_GREENYELLOW, TFT_YELLOW,
-                              TFT_GOLD, TFT_ORANGE, TFT_RED, TFT_BROWN
-                             };
-  const int decal = 15;
-  int x = x0 * (w + 2);
-  int dh = (display.height() - decal) / 8;
-  for (int i = 1; i < 8; i++) {
-    if (h > i * dh) {
-      int y = display.height() - decal - i * dh;
-      display.fillRect(x, y, w, dh, colors[i - 1]);
-    } else {
-      int y = display.height() - decal - h;
-      display.fillRect(x, y, w, h - (i - 1) * dh, colors[i - 1]);
-      break;
+  // Affichage du spectre et des peaks (une ligne sur 2)
+  int ampmax = 0;
+  int imax = 0;
+  for (int i = 2; i < nFreq; i++) {
+    int amplitude = (int)creal(data[i]) / COEF;
+    if (amplitude > ampmax) {
+      ampmax = amplitude;
+      imax = i;
     }
+    specview_bar(&spectrumView, i * 2, 1, amplitude, marker[i]);
+    specview_bar(&spectrumView, i * 2 + 1, 1, 0, marker[i]);
+  }
+
+  // Affichage fréquence de plus forte amplitude, effacée par les barres
+  static int textX = 0, textW = 0, textH = 0;
+  specview_repaint(&spectrumView, textX, 0, textW, textH);
+  textW = 0;
+  if (ampmax > 20) {
+    display.setTextSize(2);
+    display.setTextColor(TFT_BLUE);
+    int freqmax = 985.0 * imax * MAX_FREQ / SAMPLES;
+    char texte[14];
+    sprintf(texte, "%4d Hz: %3d", freqmax, ampmax);
+    textX = display.width() - 145;
+    textW = display.textWidth(texte, 1);
+    textH = display.fontHeight(1);
+    display.drawString(texte, textX, 0, 1);
   }
 }
 
-void displaySpectrum2 () {
-  window (data, LOG2SAMPLE, HAMMING, FFT_FORWARD);
-  ffti_f(data, LOG2SAMPLE, FFT_FORWARD);
+void displaySpectrum2 (bool erase) {
+  window_apply((float *) data, LOG2SAMPLE, HAMMING);
+  rfft_f((float *) data, LOG2SAMPLE);
   int nFreq = SAMPLES / 2;
   int hauteur = display.height();
-  display.fillScreen(TFT_BLACK);
-  display.setTextColor(TFT_WHITE);
-  display.setTextSize(1);
-  const float freqs[6] = {.5, 1, 1.5, 2, 3, 4};
-  for (int i = 0; i < 6; i++) {
-    int pos =  FREQ2IND * freqs[i] * 3.8 ;
-    if (i == 0) display.drawString(".5", pos - 5, hauteur - 13, 2);
-    else if (i == 2) display.drawString("1.5", pos - 5, hauteur - 13, 2);
-    else display.drawString(String(freqs[i], 0), pos, hauteur - 13, 2);
+  if (specview_begin(&spectrumView2, erase)) {
+    display.fillScreen(TFT_BLACK);
+    display.setTextColor(TFT_WHITE);
+    display.setTextSize(1);
+    const float freqs[6] = {.5, 1, 1.5, 2, 3, 4};
+    for (int i = 0; i < 6; i++) {
+      int pos =  FREQ2IND * freqs[i] * 3.8 ;
+      if (i == 0) display.drawString(".5", pos - 5, hauteur - 13, 2);
+      else if (i == 2) display.drawString("1.5", pos - 5, hauteur - 13, 2);
+      else display.drawString(String(freqs[i], 0), pos, hauteur - 13, 2);
+    }
+    display.drawString("kHz", display.width() - 22, hauteur - 13, 2);
   }
-  display.drawString("kHz", display.width() - 22, hauteur - 13, 2);
 
   const int decal = 15;
-  // Affichage du spectre
-  for (int i = 0; i < nFreq / 2; i++) {
+  const int dh = (hauteur - decal) / 8;
+  // Affichage du spectre: barres de 13 pixels, 7 niveaux de couleur
+  for (int i = 0; i < (nFreq - 2) / 8; i++) {
     int amplitude = 0;
     for (int j = 0; j < 8; j++) amplitude += abs((int)creal(data[i * 8 + j + 2]) / COEF);
-    amplitude = min(amplitude, hauteur - decal);
-    rectangleGR (i, 13, amplitude);
+    amplitude = min(amplitude, 7 * dh);
+    specview_bar(&spectrumView2, i * 15, 13, amplitude, -1);
   }
 }
 
@@ -379,16 +323,24 @@ void displayEnvelope(bool erase) {
   ++i;
 }
 
+// Running envelope: 10 ms peak to peak amplitudes, one per column, in a
+// sweep. Only the column of the new amplitude and the gap ahead of it
+// are drawn: the oldest amplitudes are erased as the sweep goes.
+runplot envelope;
+
 void displayRunningEnvelope(bool erase) {
-  if (erase) display.fillScreen(TFT_BLACK);
+  const int gap = 4; // black columns ahead of the sweep
   static int ampMaxOld = 0;
   static int ampMinOld = 1024;
   const int decal = 15;
   const int hauteur = display.height();
   const int N = display.width();
-  static int sound[240] = {0};
-  int save = sound[0];
-  for (int i = 0; i < N - 1 ; i++) sound[i] = sound[i + 1];
+  // No memory for the history: nothing drawn (tried again at the next call)
+  if (envelope.values == NULL && !runplot_init(&envelope, N)) return;
+  if (erase) {
+    display.fillScreen(TFT_BLACK);
+    runplot_clear(&envelope);
+  }
 
   unsigned int signalMax = 0;
   unsigned int signalMin = 4096;
@@ -402,19 +354,19 @@ void displayRunningEnvelope(bool erase) {
   int x = peakToPeak - SENSITIVITY;
   if (x < 0)   x = 0;
   if (x > 500) x = 500;
-  sound[N - 1] = map(x, 0, 500, 1, hauteur - decal);
+  int amp = map(x, 0, 500, 1, hauteur - decal);
+
+  int col = runplot_push(&envelope, amp);
+  int prev;
+  bool joined = runplot_previous(&envelope, &prev);
+  display.fillRect(col, decal, min(gap, N - col), hauteur - decal, TFT_BLACK);
+  if (joined && col > 0) display.drawLine (col - 1, hauteur - prev, col, hauteur - amp, TFT_GREEN);
+  else display.drawPixel (col, hauteur - amp, TFT_GREEN);
 
-  int ampMin = 500;
-  int ampMax = 0;
-  display.drawLine (0, hauteur - save, 1, hauteur - sound[0], TFT_BLACK);
-  for (int j = 1; j < N; j++) {
-    if (sound[j] > ampMax) ampMax = sound[j];
-    if (sound[j] < ampMin) ampMin = sound[j];
-    if (ampMin == 1) ampMin = 0;
-    display.drawLine (j, hauteur - sound[j - 1], j + 1, hauteur - sound[j], TFT_BLACK);
-    display.drawLine (j - 1, hauteur - sound[j - 1], j, hauteur - sound[j], TFT_GREEN);
-  }
   // Affichage bornes d'amplitude
+  int ampMin = runplot_min(&envelope);
+  int ampMax = runplot_max(&envelope);
+  if (ampMin == 1) ampMin = 0;
   if ((ampMaxOld != ampMax) || (ampMinOld != ampMin) || erase) {
     display.fillRect(0, 0, N, 15, TFT_BLACK);
     char texte[25];
@@ -9,6 +9,7 @@
 #define BLACKMAN_HARRIS 0x07 /* blackman harris*/
 #define FLT_TOP 0x08 /* flat top */
 #define WELCH 0x09 /* welch */
+#define WINDOW_TYPES 10 /* number of window types */
 
 // FFT parameters
 #define SAMPLES 256
@@ -0,0 +1,96 @@
+/*
+   Running plot history
+
+   The last n values of a running plot in a ring buffer: a new value
+   overwrites the oldest one, nothing is shifted. The position of a
+   value in the ring is also its column on screen, so that the plot is
+   drawn as a sweep: only the column of the new value changes.
+
+   The min and max of the n values are kept by two monotonic deques (of
+   the values which may still become the min / max before they leave
+   the window): O(1) per value on average, no rescan.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct
+{
+  int *values;               // ring of the last n values
+  int n;
+  unsigned long count;       // values pushed
+  unsigned long *minq;       // deques of value numbers, values increasing
+  unsigned long *maxq;       // and decreasing from the front
+  unsigned long minFront, minBack, maxFront, maxBack; // deque positions (mod n)
+}
+runplot;
+
+void runplot_free(runplot *r)
+{
+  free(r->values);
+  free(r->minq);
+  free(r->maxq);
+  r->values = NULL;
+  r->minq = r->maxq = NULL;
+}
+
+// Returns false, nothing allocated (values NULL), if the memory is missing
+bool runplot_init(runplot *r, int n)
+{
+  r->n = n;
+  r->values = (int *) malloc(n * sizeof(int));
+  r->minq = (unsigned long *) malloc(n * sizeof(unsigned long));
+  r->maxq = (unsigned long *) malloc(n * sizeof(unsigned long));
+  r->count = 0;
+  r->minFront = r->minBack = r->maxFront = r->maxBack = 0;
+  if (r->values == NULL || r->minq == NULL || r->maxq == NULL) {
+    runplot_free(r);
+    return false;
+  }
+  return true;
+}
+
+void runplot_clear(runplot *r)
+{
+  r->count = 0;
+  r->minFront = r->minBack = r->maxFront = r->maxBack = 0;
+}
+
+static inline int runplot_value(const runplot *r, unsigned long k)
+{
+  return r->values[k % r->n];
+}
+
+// Adds a value, returns its column (0 ... n - 1)
+int runplot_push(runplot *r, int v)
+{
+  const unsigned long k = r->count++;
+  // Values leaving the window
+  if (r->minFront != r->minBack && r->minq[r->minFront % r->n] + r->n <= k) ++r->minFront;
+  if (r->maxFront != r->maxBack && r->maxq[r->maxFront % r->n] + r->n <= k) ++r->maxFront;
+  r->values[k % r->n] = v;
+  // Values which cannot be the min / max any more
+  while (r->minBack != r->minFront && runplot_value(r, r->minq[(r->minBack - 1) % r->n]) >= v) --r->minBack;
+  r->minq[r->minBack++ % r->n] = k;
+  while (r->maxBack != r->maxFront && runplot_value(r, r->maxq[(r->maxBack - 1) % r->n]) <= v) --r->maxBack;
+  r->maxq[r->maxBack++ % r->n] = k;
+  return k % r->n;
+}
+
+// Min and max of the values in the window (0 if empty)
+int runplot_min(const runplot *r)
+{
+  return (r->count == 0) ? 0 : runplot_value(r, r->minq[r->minFront % r->n]);
+}
+
+int runplot_max(const runplot *r)
+{
+  return (r->count == 0) ? 0 : runplot_value(r, r->maxq[r->maxFront % r->n]);
+}
+
+// Value pushed before the last one, if any
+bool runplot_previous(const runplot *r, int *v)
+{
+  if (r->count < 2) return false;
+  *v = runplot_value(r, r->count - 2);
+  return true;
+}
@@ -0,0 +1,189 @@
+/*
+   Retained spectrum renderer
+
+   Draws bar graphs (a bar and a peak marker per pixel column) without
+   clearing the screen: the bar heights and markers already on screen
+   are kept, and a new frame only fills the rows of the columns that
+   changed. The static parts of the screen (axes, labels) are drawn once
+   by the sketch, after a full redraw, outside of the plot area, and are
+   never touched again.
+
+   The view draws through a fill function (a rectangle of a color), so
+   that it works with the TFT (TFT_eSPI), the OLED (SSD1306 buffer) or a
+   host framebuffer. pixels and rects count what the last frame filled:
+   the bytes sent to a TFT are about 2 pixels + 11 rects (window and
+   write commands).
+
+   Usage:
+     if (specview_begin(&view, erase)) { clear the screen, draw the labels }
+     specview_bar(&view, x, w, height, peak);  // for the columns of the frame
+     specview_repaint(&view, ...);              // under a text drawn over the plot
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef void (*specview_fill)(int x, int y, int w, int h, uint16_t color);
+
+typedef struct
+{
+  // Plot area: columns x0 ... x0 + width - 1, rows up from base - 1
+  int x0, base, width, height;
+  specview_fill fill;
+  uint16_t bg;                  // background
+  uint16_t mark;                // peak markers
+  const uint16_t *palette;      // bar colors from the bottom,
+  int levels, levelH;           // levels of levelH rows (the last one up to the top)
+  int16_t *bar;                 // per column: bar height on screen
+  int16_t *peak;                // per column: marker row on screen, -1: none
+  bool valid;                   // false: full redraw at the next frame
+  // Statistics since specview_begin
+  unsigned long pixels, rects;
+}
+specview;
+
+bool specview_init(specview *v, int x0, int base, int width, int height, specview_fill fill,
+                   uint16_t bg, uint16_t mark, const uint16_t *palette, int levels, int levelH)
+{
+  v->x0 = x0;
+  v->base = base;
+  v->width = width;
+  v->height = height;
+  v->fill = fill;
+  v->bg = bg;
+  v->mark = mark;
+  v->palette = palette;
+  v->levels = levels;
+  v->levelH = (levelH > 0) ? levelH : height;
+  v->bar = (int16_t *) malloc(width * sizeof(int16_t));
+  v->peak = (int16_t *) malloc(width * sizeof(int16_t));
+  v->valid = false;
+  v->pixels = v->rects = 0;
+  return v->bar != NULL && v->peak != NULL;
+}
+
+// The screen was drawn over: full redraw at the next frame
+void specview_invalidate(specview *v)
+{
+  v->valid = false;
+}
+
+// Starts a frame. Returns true if the sketch must clear the screen and
+// draw the static layer (first frame, erase or invalidated): the plot
+// is then taken as empty.
+bool specview_begin(specview *v, bool erase)
+{
+  v->pixels = v->rects = 0;
+  if (v->valid && !erase) return false;
+  for (int i = 0; i < v->width; i++) {
+    v->bar[i] = 0;
+    v->peak[i] = -1;
+  }
+  v->valid = true;
+  return true;
+}
+
+// Color of row r (0: bottom) of a column
+static inline uint16_t specview_color(const specview *v, int r, int h, int p)
+{
+  if (r == p) return v->mark;
+  if (r >= h) return v->bg;
+  int level = r / v->levelH;
+  return v->palette[(level < v->levels) ? level : v->levels - 1];
+}
+
+static inline void specview_rect(specview *v, int x, int w, int r0, int r1, uint16_t color)
+{
+  v->fill(x, v->base - r1, w, r1 - r0, color);
+  v->pixels += (unsigned long) w * (r1 - r0);
+  ++v->rects;
+}
+
+// Fills the rows r0 ... r1 - 1 of the columns x ... x + w - 1 which do
+// not have the same color with (h, p) as with (oh, op), in runs of a color
+static void specview_diff(specview *v, int x, int w, int r0, int r1,
+                          int h, int p, int oh, int op, bool all)
+{
+  int start = -1;
+  uint16_t color = 0;
+  for (int r = r0; r <= r1; r++) {
+    bool changed = false;
+    uint16_t c = 0;
+    if (r < r1) {
+      c = specview_color(v, r, h, p);
+      changed = all || c != specview_color(v, r, oh, op);
+    }
+    if (start >= 0 && (!changed || c != color)) {
+      specview_rect(v, x, w, start, r, color);
+      start = -1;
+    }
+    if (changed && start < 0) {
+      start = r;
+      color = c;
+    }
+  }
+}
+
+// Columns x ... x + w - 1 (screen) get a bar of h rows and a marker on
+// row p (-1: none). Only the rows which changed are filled, at once for
+// the w columns if they were alike.
+void specview_bar(specview *v, int x, int w, int h, int p)
+{
+  int i = x - v->x0;
+  if (i < 0) {
+    w += i;
+    i = 0;
+  }
+  if (i + w > v->width) w = v->width - i;
+  if (w <= 0) return;
+  if (h < 0) h = 0;
+  if (h > v->height) h = v->height;
+  if (p >= v->height) p = v->height - 1;
+  if (p < 0) p = -1;
+  bool alike = true;
+  for (int j = 1; j < w && alike; j++)
+    alike = v->bar[i + j] == v->bar[i] && v->peak[i + j] == v->peak[i];
+  if (!alike) {
+    for (int j = 0; j < w; j++) specview_bar(v, x + j, 1, h, p);
+    return;
+  }
+  const int oh = v->bar[i], op = v->peak[i];
+  // Rows which may change: between the bar tops, and the markers
+  const int lo = (h < oh) ? h : oh;
+  const int hi = (h < oh) ? oh : h;
+  specview_diff(v, v->x0 + i, w, lo, hi, h, p, oh, op, false);
+  if (op >= 0 && (op < lo || op >= hi)) specview_diff(v, v->x0 + i, w, op, op + 1, h, p, oh, op, false);
+  if (p >= 0 && p != op && (p < lo || p >= hi)) specview_diff(v, v->x0 + i, w, p, p + 1, h, p, oh, op, false);
+  for (int j = 0; j < w; j++) {
+    v->bar[i + j] = h;
+    v->peak[i + j] = p;
+  }
+}
+
+// Redraws the plot in the rectangle (screen coordinates) from the bars
+// and markers on screen: erases a text drawn over the plot
+void specview_repaint(specview *v, int x, int y, int w, int h)
+{
+  int r0 = v->base - (y + h), r1 = v->base - y;
+  if (r0 < 0) r0 = 0;
+  if (r1 > v->height) r1 = v->height;
+  if (x < v->x0) {
+    w -= v->x0 - x;
+    x = v->x0;
+  }
+  if (x + w > v->x0 + v->width) w = v->x0 + v->width - x;
+  for (int j = 0; j < w && r0 < r1; ) {
+    // Columns alike, at once
+    const int i = x - v->x0 + j;
+    int n = 1;
+    while (j + n < w && v->bar[i + n] == v->bar[i] && v->peak[i + n] == v->peak[i]) ++n;
+    specview_diff(v, x + j, n, r0, r1, v->bar[i], v->peak[i], v->bar[i], v->peak[i], true);
+    j += n;
+  }
+}
+
+void specview_free(specview *v)
+{
+  free(v->bar);
+  free(v->peak);
+  v->bar = v->peak = NULL;
+}
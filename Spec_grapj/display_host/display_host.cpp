@@ -0,0 +1,194 @@
+/*
+   Display bandwidth of the spectrum modes of SoundAnalyzer_ESP32_TTGO
+
+   Runs the displaySpectrum, displaySpectrum2 and displayRunningEnvelope
+   of the sketch on the host, on a synthetic sound (a tone sweeping 300 Hz ... 4 kHz over
+   noise), into a framebuffer that stands for the 240x135 TFT and
+   counts what is sent to it: pixels, rectangles (address windows), and
+   bytes as on the SPI bus (2 per pixel, 11 per window). Each mode is
+   run twice on the same sound: with a full redraw at each frame (as
+   before the retained views of specview.h) and incrementally, and the
+   two last pictures are compared. The running envelope draws a column
+   per call, its bytes per call are printed.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 display_host.cpp -o display_host
+     ./display_host [frames]
+   The text is counted as its box (TFT_eSPI draws the pixels of the
+   glyphs only), so the labels are a bit overcounted.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "../SoundAnalyzer_ESP32_TTGO/params.h"
+
+// Arduino and TFT_eSPI, what the sketch uses
+typedef uint8_t byte;
+using std::min;
+using std::max;
+#define complex _Complex
+#define creal(z) __builtin_creal(z)
+#define PI M_PI
+#define sq(x) ((x) * (x))
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+#define TFT_BLACK       0x0000
+#define TFT_WHITE       0xFFFF
+#define TFT_BLUE        0x001F
+#define TFT_RED         0xF800
+#define TFT_GREEN       0x07E0
+#define TFT_DARKGREEN   0x03E0
+#define TFT_GREENYELLOW 0xB7E0
+#define TFT_YELLOW      0xFFE0
+#define TFT_GOLD        0xFEA0
+#define TFT_ORANGE      0xFDA0
+#define TFT_BROWN       0x9A60
+
+static long map(long x, long a, long b, long c, long d)
+{
+  return (x - a) * (d - c) / (b - a) + c;
+}
+
+class String
+{
+  public:
+    String(const char* s) { snprintf(text, sizeof(text), "%s", s); }
+    String(float x, int decimals) { snprintf(text, sizeof(text), "%.*f", decimals, (double) x); }
+    const char* c_str() const { return text; }
+  private:
+    char text[24];
+};
+
+// Synthetic microphone: a time base advanced by micros(), so that the
+// sampling loops of the sketch run at MAX_FREQ
+static unsigned long now_us = 0;
+static double phase = 0;
+static unsigned long micros() { return ++now_us; }
+static unsigned long millis() { return now_us / 1000; }
+static void delay(unsigned long) {}
+static void delayMicroseconds(unsigned int) {}
+static int analogRead(int)
+{
+  const double t = now_us * 1e-6;
+  const double f = 300.0 + 3700.0 * (0.5 - 0.5 * cos(2 * M_PI * t / 4.0));
+  phase += 2 * M_PI * f / (MAX_FREQ * 1000.0);
+  return 1426 + (int) (600.0 * sin(phase)) + rand() % 80 - 40;
+}
+
+// Framebuffer of the TFT, counting what is sent to it
+class Framebuffer
+{
+  public:
+    unsigned long pixels = 0, rects = 0;
+    std::vector<uint16_t> screen;
+
+    Framebuffer() : screen(240 * 135, 0) {}
+    void init() {}
+    void setRotation(int) {}
+    int width() const { return 240; }
+    int height() const { return 135; }
+    unsigned long bytes() const { return 2 * pixels + 11 * rects; }
+
+    void fillRect(int x, int y, int w, int h, uint16_t color)
+    {
+      if (x < 0) { w += x; x = 0; }
+      if (y < 0) { h += y; y = 0; }
+      if (x + w > width()) w = width() - x;
+      if (y + h > height()) h = height() - y;
+      if (w <= 0 || h <= 0) return;
+      for (int j = y; j < y + h; j++)
+        for (int i = x; i < x + w; i++) screen[j * width() + i] = color;
+      pixels += w * h;
+      ++rects;
+    }
+    void fillScreen(uint16_t color) { fillRect(0, 0, width(), height(), color); }
+    void drawPixel(int x, int y, uint16_t color) { fillRect(x, y, 1, 1, color); }
+    void drawFastVLine(int x, int y, int h, uint16_t color) { fillRect(x, y, 1, h, color); }
+    void drawFastHLine(int x, int y, int w, uint16_t color) { fillRect(x, y, w, 1, color); }
+    void drawLine(int x0, int y0, int x1, int y1, uint16_t color)
+    {
+      const int n = max(abs(x1 - x0), abs(y1 - y0));
+      for (int k = 0; k <= n; k++)
+        fillRect(x0 + (n ? (x1 - x0) * k / n : 0), y0 + (n ? (y1 - y0) * k / n : 0), 1, 1, color);
+    }
+
+    // Text: its box in the text color
+    void setTextColor(uint16_t color) { textColor = color; }
+    void setTextSize(int size) { textSize = size; }
+    int fontHeight(int font) const { return (font == 1 ? 8 : 16) * textSize; }
+    int textWidth(const char* s, int font) const { return strlen(s) * (font == 1 ? 6 : 8) * textSize; }
+    void drawString(const char* s, int x, int y, int font)
+    {
+      fillRect(x, y, textWidth(s, font), fontHeight(font), textColor);
+    }
+    void drawString(const String& s, int x, int y, int font) { drawString(s.c_str(), x, y, font); }
+
+  private:
+    uint16_t textColor = TFT_WHITE;
+    int textSize = 1;
+};
+
+// Globals of SoundAnalyzer_ESP32_TTGO.ino
+#define FREQ2IND (SAMPLES * 1.0 / MAX_FREQ)
+#define MIC 32
+Framebuffer display;
+unsigned long chrono, chrono1;
+unsigned long sampling_period_us;
+byte peak[SAMPLES] = {0};
+float complex data[SAMPLES / 2];
+int sound[SAMPLES];
+float MULT = MAX_FREQ * 1000.0 / SAMPLES;
+unsigned int P2P = 0;
+int LOG2SAMPLE = log(SAMPLES) / log(2);
+#include "../SoundAnalyzer_ESP32_TTGO/fft.h"
+#include "../SoundAnalyzer_ESP32_TTGO/specview.h"
+#include "../SoundAnalyzer_ESP32_TTGO/runplot.h"
+#include "../SoundAnalyzer_ESP32_TTGO/functions.h"
+
+// Runs frames of a mode, full redraws or incremental, returns the bytes
+static unsigned long run(void (*mode)(bool), int frames, bool full, std::vector<uint16_t>& last)
+{
+  now_us = 0;
+  phase = 0;
+  srand(1);
+  memset(peak, 0, sizeof(peak));
+  display.fillScreen(TFT_BLUE);  // something else on screen before
+  display.pixels = display.rects = 0;
+  for (int i = 0; i < frames; i++) {
+    acquireSound();
+    mode(full || i == 0);
+  }
+  last = display.screen;
+  return display.bytes();
+}
+
+int main(int argc, char** argv)
+{
+  const int frames = (argc > 1) ? atoi(argv[1]) : 200;
+  sampling_period_us = round(1000ul * (1.0 / MAX_FREQ));
+  rfft_init(LOG2SAMPLE);
+  initSpectrumViews();
+  struct { const char* name; void (*mode)(bool); } modes[] = {
+    {"displaySpectrum", displaySpectrum},
+    {"displaySpectrum2", displaySpectrum2}
+  };
+  printf("%d frames, bytes per frame (SPI at 40 MHz)\n", frames);
+  for (auto& m : modes) {
+    std::vector<uint16_t> fullScreen, incScreen;
+    const unsigned long full = run(m.mode, frames, true, fullScreen);
+    const unsigned long inc = run(m.mode, frames, false, incScreen);
+    printf("%-17s full %6lu (%5.2f ms)  incremental %6lu (%5.2f ms)  %5.1fx less, same picture: %s\n",
+           m.name, full / frames, full / frames * 8 / 40e3, inc / frames, inc / frames * 8 / 40e3,
+           (double) full / inc, fullScreen == incScreen ? "yes" : "NO");
+  }
+  // Running envelope: a sweep, one column per call
+  display.pixels = display.rects = 0;
+  for (int i = 0; i < frames; i++) displayRunningEnvelope(i == 0);
+  printf("%-17s %6lu bytes per new amplitude (%5.3f ms)\n", "RunningEnvelope",
+         display.bytes() / frames, display.bytes() / frames * 8 / 40e3);
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+   Spectrum of ESP32_Spectrum_Display_02: arduinoFFT against fft.h
+
+   Times the spectrum of a frame of the sketch on the host, as it was
+   (arduinoFFT in double: Windowing, Compute and ComplexToMagnitude on
+   vReal / vImag) and as it is (the samples windowed into their slots,
+   rfft_evaluate_f and rfft_magnitude_f, with sqrtf or alpha max plus
+   beta min). The sound is a tone sweeping 100 Hz ... 15 kHz over noise,
+   as read by the ADC. Prints the time of a spectrum, the frames per
+   second of the loop (the 12.8 ms of the sampling included), the memory
+   of the buffers and of the tables built by rfft_init (twiddles and
+   slots), and the error of the magnitudes, relative to the loudest bin
+   of the frame, against an exact DFT in double (computed term by term
+   on the first EXACT_FRAMES frames) and against arduinoFFT.
+
+   The ESP32 has no double precision unit: the gap on the board is much
+   bigger than on the host.
+
+   Build and run, with the arduinoFFT 1.x library of the Arduino IDE:
+     g++ -O2 -std=gnu++17 -I<arduinoFFT>/src fft_host.cpp <arduinoFFT>/src/arduinoFFT.cpp -o fft_host
+     ./fft_host [frames]
+   Without it (no -I), only fft.h is run, against the exact DFT.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#define complex _Complex
+#include "../../ESP32_Spectrum_Display_02/fft.h"
+#if __has_include("arduinoFFT.h")
+#include "arduinoFFT.h"  // after fft.h: its FFT_FORWARD is a macro
+#define HAVE_ARDUINOFFT 1
+#else
+#define HAVE_ARDUINOFFT 0
+#endif
+
+#define SAMPLES 512              // as in the sketch
+#define SAMPLING_FREQUENCY 40000
+#define LOG2SAMPLE 9
+
+#define EXACT_FRAMES 100         // frames of the exact DFT
+
+static double now_us()
+{
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// analogRead(A0) of the frames: a tone over noise, its frequency sweeping
+static std::vector<int> sound(int frames)
+{
+  std::vector<int> adc(frames * SAMPLES);
+  double phase = 0;
+  srand(1);
+  for (size_t n = 0; n < adc.size(); n++) {
+    const double f = 100.0 * pow(150.0, (double) (n / SAMPLES % 64) / 63);
+    phase += 2 * M_PI * f / SAMPLING_FREQUENCY;
+    adc[n] = 1426 + (int) (600.0 * sin(phase)) + rand() % 80 - 40;
+  }
+  return adc;
+}
+
+// Hamming window of the sketch (and of arduinoFFT 1.x)
+static double hammingCoef(int i)
+{
+  return 0.54 - 0.46 * cos(2 * M_PI * i / (SAMPLES - 1));
+}
+
+// Magnitudes of the windowed frames, SAMPLES / 2 bins each, by the DFT
+// sums in double
+static std::vector<double> exactDFT(const std::vector<int>& adc, int frames)
+{
+  std::vector<double> exact(frames * SAMPLES / 2), x(SAMPLES), c(SAMPLES), s(SAMPLES);
+  for (int n = 0; n < SAMPLES; n++) {
+    c[n] = cos(2 * M_PI * n / SAMPLES);
+    s[n] = sin(2 * M_PI * n / SAMPLES);
+  }
+  for (int f = 0; f < frames; f++) {
+    for (int i = 0; i < SAMPLES; i++) x[i] = adc[f * SAMPLES + i] * hammingCoef(i);
+    for (int k = 0; k < SAMPLES / 2; k++) {
+      double re = 0, im = 0;
+      for (int n = 0; n < SAMPLES; n++) {
+        re += x[n] * c[(k * n) % SAMPLES];
+        im -= x[n] * s[(k * n) % SAMPLES];
+      }
+      exact[f * SAMPLES / 2 + k] = sqrt(re * re + im * im);
+    }
+  }
+  return exact;
+}
+
+// Max error of the magnitudes against a reference, relative to the
+// loudest bin of the frame, bins 2 and up as the sketch
+template <typename T>
+static double maxError(const T* mag, const std::vector<double>& ref, int frames)
+{
+  double error = 0;
+  for (int f = 0; f < frames; f++) {
+    const double* r = &ref[f * SAMPLES / 2];
+    const T* m = &mag[f * SAMPLES / 2];
+    double loudest = 0, worst = 0;
+    for (int k = 2; k < SAMPLES / 2; k++) {
+      loudest = fmax(loudest, r[k]);
+      worst = fmax(worst, fabs(m[k] - r[k]));
+    }
+    error = fmax(error, worst / loudest);
+  }
+  return error;
+}
+
+int main(int argc, char** argv)
+{
+  const int frames = (argc > 1) ? atoi(argv[1]) : 2000;
+  const std::vector<int> adc = sound(frames);
+  const int exactFrames = (frames < EXACT_FRAMES) ? frames : EXACT_FRAMES;
+  const std::vector<double> exact = exactDFT(adc, exactFrames);
+  printf("%d frames of %d samples at %d Hz, exact DFT of %d frames\n\n", frames, SAMPLES,
+         SAMPLING_FREQUENCY, exactFrames);
+  printf("%-28s %8s %12s %10s %10s %12s %14s\n", "", "us/frame", "loop frames/s", "buffers", "tables",
+         "error/exact", "error/arduino");
+  double start;
+
+#if HAVE_ARDUINOFFT
+  // arduinoFFT, as the sketch was
+  arduinoFFT FFT = arduinoFFT();
+  static double vReal[SAMPLES], vImag[SAMPLES];
+  std::vector<double> reference(frames * SAMPLES / 2);
+  start = now_us();
+  for (int f = 0; f < frames; f++) {
+    const int* x = &adc[f * SAMPLES];
+    for (int i = 0; i < SAMPLES; i++) {
+      vReal[i] = x[i];
+      vImag[i] = 0;
+    }
+    FFT.Windowing(vReal, SAMPLES, FFT_WIN_TYP_HAMMING, FFT_FORWARD);
+    FFT.Compute(vReal, vImag, SAMPLES, FFT_FORWARD);
+    FFT.ComplexToMagnitude(vReal, vImag, SAMPLES);
+    for (int k = 0; k < SAMPLES / 2; k++) reference[f * SAMPLES / 2 + k] = vReal[k];
+  }
+  const double arduinoUs = (now_us() - start) / frames;
+  printf("%-28s %8.1f %12.1f %8zu B %8d B %12.2g %14s\n", "arduinoFFT (double)", arduinoUs,
+         1e6 / (1e6 / SAMPLING_FREQUENCY * SAMPLES + arduinoUs), sizeof(vReal) + sizeof(vImag), 0,
+         maxError(reference.data(), exact, exactFrames), "-");
+#endif
+
+  // fft.h, as the sketch is
+  static float data[SAMPLES], hamming[SAMPLES / 2];
+  rfft_init(LOG2SAMPLE);
+  const uint16_t* slot = rfft_slots(LOG2SAMPLE);
+  // Twiddles (a quarter wave of cosines) and slots of rfft_init
+  const size_t tables = (SAMPLES / 4 + 1) * sizeof(float) + SAMPLES * sizeof(uint16_t);
+  for (int i = 0; i < SAMPLES / 2; i++) hamming[i] = hammingCoef(i);
+  std::vector<float> magnitude(frames * SAMPLES / 2);
+  for (int fast = 0; fast <= 1; fast++) {
+    start = now_us();
+    for (int f = 0; f < frames; f++) {
+      const int* x = &adc[f * SAMPLES];
+      for (int i = 0; i < SAMPLES; i++) {
+        float w = (i < SAMPLES / 2) ? hamming[i] : hamming[SAMPLES - 1 - i];
+        data[slot[i]] = x[i] * w;
+      }
+      rfft_evaluate_f(data, LOG2SAMPLE);
+      rfft_magnitude_f(data, LOG2SAMPLE, fast);
+      for (int k = 0; k < SAMPLES / 2; k++) magnitude[f * SAMPLES / 2 + k] = data[k];
+    }
+    const double us = (now_us() - start) / frames;
+    char againstArduino[16] = "-";
+#if HAVE_ARDUINOFFT
+    snprintf(againstArduino, sizeof(againstArduino), "%.2g", maxError(magnitude.data(), reference, frames));
+#endif
+    printf("%-28s %8.1f %12.1f %8zu B %8zu B %12.2g %14s\n", fast ? "fft.h, alpha max beta min" : "fft.h, sqrtf",
+           us, 1e6 / (1e6 / SAMPLING_FREQUENCY * SAMPLES + us), sizeof(data) + sizeof(hamming), tables,
+           maxError(magnitude.data(), exact, exactFrames), againstArduino);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+   Loop frame times with and without the background display flush
+
+   Simulates the loop of ESP32_Spectrum_Display_02 on the host: the
+   acquisition of 512 samples at 40 kHz (12.8 ms), the FFT and the
+   drawing (1 ms), then the picture is sent to the 128x64 SSD1306 on a
+   fake I2C bus, either in the loop (display.display()) or by the
+   service of oled_flush.h. Prints the histogram of the loop times of
+   both.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 -pthread flush_host.cpp -o flush_host
+     ./flush_host [frames] [bus Hz]
+   The bus clock can also be set at build time: -DOLED_BUS_HZ=700000.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+static unsigned long busHz = 400000;
+#define OLED_BUS_HZ busHz
+#include "../../ESP32_Spectrum_Display_02/oled_flush.h"
+
+#define DISPLAY_PERIOD 40ul  // as in the sketch
+
+static void work(unsigned long us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// Loop times in microseconds, the picture sent by the loop or the service
+static std::vector<unsigned long> run(int frames, bool service, oled_flush* f)
+{
+  uint8_t picture[1024] = {0};
+  std::vector<unsigned long> times;
+  if (service) oled_begin(f, 0x3c, 128, 64, DISPLAY_PERIOD);
+  else {
+    f->width = 128;
+    f->height = 64;
+    f->size = 1024;
+    f->address = 0x3c;
+  }
+  for (int i = 0; i < frames; i++) {
+    const unsigned long start = oled_micros();
+    work(12800);             // 512 samples at 40 kHz
+    work(1000);              // FFT and drawing
+    picture[i % 1024] ^= 1;
+    if (service) oled_present(f, picture);
+    else oled_send(f, picture);
+    times.push_back(oled_micros() - start);
+  }
+  return times;
+}
+
+static void report(const char* name, std::vector<unsigned long> t, unsigned long pictures)
+{
+  std::sort(t.begin(), t.end());
+  double total = 0;
+  for (unsigned long x : t) total += x;
+  printf("\n%s: %.1f loops/s, %lu pictures sent\n", name, t.size() * 1e6 / total, pictures);
+  printf("  median %.1f ms, 99%% %.1f ms, max %.1f ms\n",
+         t[t.size() / 2] / 1000.0, t[t.size() * 99 / 100] / 1000.0, t.back() / 1000.0);
+  const int bin = 2000;  // 2 ms
+  std::vector<int> counts(t.back() / bin + 1, 0);
+  for (unsigned long x : t) ++counts[x / bin];
+  for (size_t b = 0; b < counts.size(); b++) {
+    if (counts[b] == 0) continue;
+    printf("  %3zu-%3zu ms %5d ", b * 2, b * 2 + 2, counts[b]);
+    for (int k = 0; k < counts[b] * 50 / (int) t.size(); k++) putchar('#');
+    putchar('\n');
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const int frames = (argc > 1) ? atoi(argv[1]) : 200;
+  if (argc > 2) busHz = strtoul(argv[2], NULL, 10);
+  printf("%d loops, I2C bus at %lu Hz, a picture every %lu ms at most with the service\n",
+         frames, busHz, DISPLAY_PERIOD);
+  oled_flush f;
+  std::vector<unsigned long> t = run(frames, false, &f);
+  report("display.display() in the loop", t, frames);
+  t = run(frames, true, &f);
+  oled_end(&f);
+  report("oled_present, background flush", t, f.sent);
+  printf("  %lu pictures replaced before being sent, longest send %.1f ms\n",
+         f.replaced, f.maxSendUs / 1000.0);
+  return 0;
+}
@@ -0,0 +1,402 @@
+/*
+   FFT engine
+
+   The twiddle factors of each transform size are computed once
+   (fft_init) and kept in a table, the butterflies run in single
+   precision and two radix-2 stages are merged into one radix-4 pass.
+   Call shape is unchanged: ffti_f(data, log2_N, direction)
+   The table only holds a quarter wave of cosines (N/4 + 1 floats): the
+   butterflies get W^k from it by symmetry (fft_w).
+
+   rfft_f(data, log2_N) transforms N real samples with an N/2 points
+   complex FFT, for half the time and memory.
+
+   The bit-reversal permutation is a list of index pairs built once per
+   size. It can be skipped altogether by writing the samples directly in
+   their bit-reversed slots (rfft_slots) and calling rfft_evaluate_f.
+   The real FFT only needs the slots (N uint16) and the table of N
+   points: 1.5 KB for N = 512.
+
+   rfft_magnitude_f turns the bins into their magnitudes, in place, with
+   sqrtf or the alpha max plus beta min approximation.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define FFT_MAX_LOG2 12   // biggest transform: 4096 points
+
+typedef enum fft_dir {
+  FFT_FORWARD,    /* kernel uses "-1" sign */
+  FFT_INVERSE     /* kernel uses "+1" sign */
+} fft_dir;
+
+// Twiddle tables (quarter waves), one per transform size
+static float* fft_twiddles[FFT_MAX_LOG2 + 1] = {NULL};
+// Bit-reversal tables: swap pairs, and sample slots for the real FFT
+static uint16_t* fft_swaps[FFT_MAX_LOG2 + 1] = {NULL};
+static unsigned int fft_nswaps[FFT_MAX_LOG2 + 1] = {0};
+static uint16_t* rfft_slot[FFT_MAX_LOG2 + 1] = {NULL};
+
+// Returns the twiddle table of a 2^log2_N points transform, and builds it
+// on first call. It holds cos(2.PI.k/N) for k <= N/4, see fft_w.
+const float* fft_twiddle(unsigned int log2_N)
+{
+  if (log2_N > FFT_MAX_LOG2) return NULL;
+  if (fft_twiddles[log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;
+    unsigned int size = N / 4 + 1;
+    float* c = (float*) malloc(size * sizeof(float));
+    if (c == NULL) return NULL;
+    for (unsigned int k = 0; k < size; k++)
+      c[k] = cos(2.0 * M_PI * k / N);   /* Use double for precision */
+    fft_twiddles[log2_N] = c;
+  }
+  return fft_twiddles[log2_N];
+}
+
+// W^k = exp(-2.i.PI.k/N) for k < N, from the twiddle table c of N = 4q
+// points: cos and sin of each quarter are cosines of the first one
+static inline void fft_w(const float* c, unsigned int q, unsigned int k, float* wr, float* wi)
+{
+  if (k <= q) {
+    *wr = c[k];           *wi = -c[q - k];
+  } else if (k <= 2 * q) {
+    *wr = -c[2 * q - k];  *wi = -c[k - q];
+  } else if (k <= 3 * q) {
+    *wr = -c[k - 2 * q];  *wi = c[3 * q - k];
+  } else {
+    *wr = c[4 * q - k];   *wi = c[k - 3 * q];
+  }
+}
+
+// Returns the bit-reversal swap list of a 2^log2_N points transform (the
+// (i, j) index pairs to exchange, i < j) and its number of pairs, and
+// builds it on first call
+const uint16_t* fft_swap_table(unsigned int log2_N, unsigned int* count)
+{
+  /*
+     Basic Bit-Reversal Scheme:
+
+     The incrementing pattern operations used here correspond
+     to the logic operations of a synchronous counter.
+
+     Incrementing a binary number simply flips a sequence of
+     least-significant bits, for example from 0111 to 1000.
+     So in order to compute the next bit-reversed index, we
+     have to flip a sequence of most-significant bits.
+  */
+
+  *count = 0;
+  if (log2_N > FFT_MAX_LOG2) return NULL;
+  if (fft_swaps[log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;   /* N */
+    unsigned int Nd2 = N >> 1;      /* N/2 = number range midpoint */
+    unsigned int Nm1 = N - 1;       /* N-1 = digit mask */
+    unsigned int i;                 /* index for array elements */
+    unsigned int j;                 /* index for next element swap location */
+    unsigned int n = 0;             /* number of pairs */
+    /* at most N/2 pairs, less the palindromic indexes */
+    uint16_t* pairs = (uint16_t*) malloc((N > 1 ? N : 2) * sizeof(uint16_t));
+    if (pairs == NULL) return NULL;
+
+    for (i = 0, j = 0; i < N; i++) {
+      if (j > i) {
+        pairs[2 * n] = i;
+        pairs[2 * n + 1] = j;
+        ++n;
+      }
+
+      /*
+         Find least significant zero bit
+      */
+
+      unsigned int lszb = ~i & (i + 1);
+
+      /*
+         Use division to bit-reverse the single bit so that we now have
+         the most significant zero bit
+
+         N = 2^r = 2^(m+1)
+         Nd2 = N/2 = 2^m
+         if lszb = 2^k, where k is within the range of 0...m, then
+             mszb = Nd2 / lszb
+                  = 2^m / 2^k
+                  = 2^(m-k)
+                  = bit-reversed value of lszb
+      */
+
+      unsigned int mszb = Nd2 / lszb;
+
+      /*
+         Toggle bits with bit-reverse mask
+      */
+
+      unsigned int bits = Nm1 & ~(mszb - 1);
+      j ^= bits;
+    }
+    if (n > 0) {
+      uint16_t* fit = (uint16_t*) realloc(pairs, 2 * n * sizeof(uint16_t));
+      if (fit != NULL) pairs = fit;
+    }
+    fft_swaps[log2_N] = pairs;
+    fft_nswaps[log2_N] = n;
+  }
+  *count = fft_nswaps[log2_N];
+  return fft_swaps[log2_N];
+}
+
+// Returns the slot of each of N real samples in the input of rfft_evaluate_f
+// (sample i goes to float data[slots[i]]), and builds it on first call.
+// Loading the samples there replaces the bit-reversal pass of rfft_f.
+const uint16_t* rfft_slots(unsigned int log2_N)
+{
+  if (log2_N < 2 || log2_N > FFT_MAX_LOG2) return NULL;
+  if (rfft_slot[log2_N] == NULL) {
+    unsigned int N = 1 << log2_N;
+    uint16_t* slots = (uint16_t*) malloc(N * sizeof(uint16_t));
+    if (slots == NULL) return NULL;
+    // Complex value n = (x[2n], x[2n+1]) moves to the bit-reversed index of n
+    for (unsigned int n = 0; n < N / 2; n++) {
+      unsigned int r = 0;
+      for (unsigned int b = 0; b < log2_N - 1; b++)
+        if (n & (1 << b)) r |= 1 << (log2_N - 2 - b);
+      slots[2 * n] = 2 * r;
+      slots[2 * n + 1] = 2 * r + 1;
+    }
+    rfft_slot[log2_N] = slots;
+  }
+  return rfft_slot[log2_N];
+}
+
+void ffti_shuffle_f(float complex *data, unsigned int log2_N)
+{
+  unsigned int n;
+  const uint16_t* pairs = fft_swap_table(log2_N, &n);
+  if (pairs == NULL) return;
+  for (const uint16_t* p = pairs; p < pairs + 2 * n; p += 2) {
+    float complex tmp = data[p[0]];
+    data[p[0]] = data[p[1]];
+    data[p[1]] = tmp;
+  }
+}
+
+// Builds the tables for a transform size (call it in setup)
+bool fft_init(unsigned int log2_N)
+{
+  unsigned int n;
+  return fft_twiddle(log2_N) != NULL && fft_swap_table(log2_N, &n) != NULL;
+}
+
+// Frees the tables of a transform size
+void fft_free(unsigned int log2_N)
+{
+  if (log2_N > FFT_MAX_LOG2) return;
+  free(fft_twiddles[log2_N]);
+  free(fft_swaps[log2_N]);
+  free(rfft_slot[log2_N]);
+  fft_twiddles[log2_N] = NULL;
+  fft_swaps[log2_N] = NULL;
+  rfft_slot[log2_N] = NULL;
+}
+
+// Butterfly passes of ffti_evaluate_f. The twiddle table tw may belong to
+// a bigger transform (2^twShift times bigger), it is then read with a
+// bigger stride: W_N^k = W_2N^2k
+static void fft_butterflies(float* A, unsigned int log2_N, fft_dir direction,
+                            const float* tw, unsigned int twShift)
+{
+  unsigned int N = 1 << log2_N;
+  unsigned int q = (N << twShift) / 4;   /* quarter of the table's transform */
+  const float s = (direction == FFT_FORWARD) ? 1.0f : -1.0f;
+
+  unsigned int h = 1;
+  if (log2_N & 1) {
+    for (unsigned int n = 0; n < 2 * N; n += 4) {
+      float re = A[n + 2];
+      float im = A[n + 3];
+      A[n + 2] = A[n] - re;
+      A[n + 3] = A[n + 1] - im;
+      A[n]     += re;
+      A[n + 1] += im;
+    }
+    h = 2;
+  }
+
+  for (; h < N; h <<= 2) {
+    unsigned int stride = (N / (4 * h)) << twShift;   /* W^k = fft_w(k * stride) */
+    for (unsigned int k = 0; k < h; k++) {
+      float w1r, w1i, w2r, w2i, w3r, w3i;
+      fft_w(tw, q, k * stride, &w1r, &w1i);
+      fft_w(tw, q, 2 * k * stride, &w2r, &w2i);
+      fft_w(tw, q, 3 * k * stride, &w3r, &w3i);
+      w1i *= s;
+      w2i *= s;
+      w3i *= s;
+      for (unsigned int n = k; n < N; n += 4 * h) {
+        float* a0 = A + 2 * n;
+        float* a1 = a0 + 2 * h;
+        float* a2 = a1 + 2 * h;
+        float* a3 = a2 + 2 * h;
+        float t1r = w2r * a1[0] - w2i * a1[1];
+        float t1i = w2r * a1[1] + w2i * a1[0];
+        float t2r = w1r * a2[0] - w1i * a2[1];
+        float t2i = w1r * a2[1] + w1i * a2[0];
+        float t3r = w3r * a3[0] - w3i * a3[1];
+        float t3i = w3r * a3[1] + w3i * a3[0];
+        float u0r = a0[0] + t1r, u0i = a0[1] + t1i;
+        float u1r = a0[0] - t1r, u1i = a0[1] - t1i;
+        float v0r = t2r + t3r,   v0i = t2i + t3i;
+        float v1r = t2r - t3r,   v1i = t2i - t3i;
+        a0[0] = u0r + v0r;     a0[1] = u0i + v0i;
+        a1[0] = u1r + s * v1i; a1[1] = u1i - s * v1r;
+        a2[0] = u0r - v0r;     a2[1] = u0i - v0i;
+        a3[0] = u1r - s * v1i; a3[1] = u1i + s * v1r;
+      }
+    }
+  }
+}
+
+void ffti_evaluate_f(float complex *data, unsigned int log2_N, fft_dir direction)
+{
+  /*
+     In-place FFT butterfly algorithm, radix-4 on bit-reversed data
+
+     input:
+         A[] = array of N shuffled complex values where N is a power of 2
+     output:
+         A[] = the DFT of input A[]
+
+     Two successive radix-2 stages of half size h and 2h are merged:
+     with W = exp(-j2π/4h), for each k < h the four values
+         a0 = A[n + k], a1 = A[n + k + h], a2 = A[n + k + 2h], a3 = A[n + k + 3h]
+     become
+         t1 = W^2k a1,  t2 = W^k a2,  t3 = W^3k a3
+         A[n + k]      = (a0 + t1) +   (t2 + t3)
+         A[n + k + h]  = (a0 - t1) - j (t2 - t3)
+         A[n + k + 2h] = (a0 + t1) -   (t2 + t3)
+         A[n + k + 3h] = (a0 - t1) + j (t2 - t3)
+     i.e. 3 complex products instead of 4. If log2(N) is odd, a first
+     radix-2 stage (no product) is done before.
+
+     For inverse FFT, use W = exp(+j2π/4h) (and +j / -j swapped)
+  */
+
+  const float* tw = fft_twiddle(log2_N);
+  if (tw == NULL) return;
+  fft_butterflies((float*) data, log2_N, direction, tw, 0);
+}
+
+void ffti_f(float complex data[], unsigned int log2_N, fft_dir direction)
+{
+  ffti_shuffle_f(data, log2_N);
+  ffti_evaluate_f(data, log2_N, direction);
+}
+
+// Builds the tables used by rfft_f for N real samples (call it in setup):
+// the twiddles of N points and the slots, which also give the
+// bit-reversal of rfft_f
+bool rfft_init(unsigned int log2_N)
+{
+  return log2_N >= 2 && fft_twiddle(log2_N) != NULL && rfft_slots(log2_N) != NULL;
+}
+
+void rfft_evaluate_f(float* data, unsigned int log2_N)
+{
+  /*
+     Forward FFT of N real values, through an N/2 points complex FFT
+
+     input:
+         data[] = N real samples x[n]
+     output:
+         (float complex *)data = bins X[0] ... X[N/2 - 1], except that the
+         imaginary part of X[0] (always 0) is replaced by the real value
+         X[N/2] (always real). The other bins are the conjugates of these.
+
+     The even and odd samples are packed in z[n] = x[2n] + j x[2n+1] and
+     Z = FFT(z) is computed on M = N/2 points. Then with W = exp(-j2π/N):
+         E[k] = (Z[k] + conj(Z[M-k])) / 2
+         O[k] = -j (Z[k] - conj(Z[M-k])) / 2
+         X[k]   = E[k] + W^k O[k]
+         X[M-k] = conj(E[k] - W^k O[k])
+     The twiddle table of the N points transform serves both steps.
+
+     The samples must already be in bit-reversed order: see rfft_f, or
+     load sample i into data[rfft_slots(log2_N)[i]].
+  */
+
+  if (log2_N < 2) return;
+  const float* tw = fft_twiddle(log2_N);
+  if (tw == NULL) return;
+  unsigned int M = 1 << (log2_N - 1);
+  fft_butterflies(data, log2_N - 1, FFT_FORWARD, tw, 1);
+
+  // Split step
+  float z0 = data[0];
+  data[0] = z0 + data[1];   // DC
+  data[1] = z0 - data[1];   // Nyquist
+  for (unsigned int k = 1; k <= M / 2; k++) {
+    float* a = data + 2 * k;
+    float* b = data + 2 * (M - k);
+    float er = 0.5f * (a[0] + b[0]), ei = 0.5f * (a[1] - b[1]);
+    float odr = 0.5f * (a[1] + b[1]), odi = -0.5f * (a[0] - b[0]);
+    float wr = tw[k], wi = -tw[M / 2 - k];   // W^k, k <= N/4
+    float tr = wr * odr - wi * odi;
+    float ti = wr * odi + wi * odr;
+    a[0] = er + tr;  a[1] = ei + ti;
+    b[0] = er - tr;  b[1] = ti - ei;
+  }
+}
+
+void rfft_f(float* data, unsigned int log2_N)
+{
+  if (log2_N < 2) return;
+  const uint16_t* slot = rfft_slots(log2_N);
+  if (slot == NULL) return;
+  // Complex value n goes to the bit-reversed index slot[2n] / 2
+  float complex* z = (float complex*) data;
+  for (unsigned int n = 0; n < 1u << (log2_N - 1); n++) {
+    unsigned int r = slot[2 * n] / 2;
+    if (r > n) {
+      float complex tmp = z[n];
+      z[n] = z[r];
+      z[r] = tmp;
+    }
+  }
+  rfft_evaluate_f(data, log2_N);
+}
+
+// Alpha max plus beta min: |X| ~ FFT_ALPHA max(|re|, |im|) + FFT_BETA min(|re|, |im|)
+// (the pair of the smallest maximum error, less than 4%)
+#define FFT_ALPHA 0.96043387f
+#define FFT_BETA  0.39782473f
+
+void rfft_magnitude_f(float* data, unsigned int log2_N, bool fast)
+{
+  /*
+     Magnitudes of the bins of rfft_f / rfft_evaluate_f
+
+     input:
+         (float complex *)data = bins X[0] ... X[N/2 - 1]
+     output:
+         data[k] = |X[k]| for k < N/2 (the Nyquist bin is dropped)
+
+     Bin k is read from data[2k] and data[2k+1] before data[k] is
+     written, so the magnitudes can overwrite the bins.
+  */
+
+  if (log2_N < 2) return;
+  unsigned int M = 1 << (log2_N - 1);
+  data[0] = fabsf(data[0]);   // DC
+  if (fast) {
+    for (unsigned int k = 1; k < M; k++) {
+      float re = fabsf(data[2 * k]), im = fabsf(data[2 * k + 1]);
+      data[k] = (re > im) ? FFT_ALPHA * re + FFT_BETA * im : FFT_ALPHA * im + FFT_BETA * re;
+    }
+  } else {
+    for (unsigned int k = 1; k < M; k++) {
+      float re = data[2 * k], im = data[2 * k + 1];
+      data[k] = sqrtf(re * re + im * im);
+    }
+  }
+}
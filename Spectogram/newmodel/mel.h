@@ -0,0 +1,170 @@
+/*
+   Log-mel spectrogram frontend, matching the training (Spectogram/tf.py):
+
+     y, sr = librosa.load(file)                 (sr = 22050 Hz, y in [-1, 1])
+     spec = librosa.feature.melspectrogram(y=y, sr=sr)
+         n_fft 2048, hop 512, periodic Hann window, power spectrum,
+         128 triangular filters on the Slaney mel scale, Slaney (area)
+         normalization, fmin 0, fmax sr / 2
+     spec = librosa.power_to_db(spec, ref=np.max)
+         10 log10(max(S, 1e-10)), minus the max of the spectrogram,
+         floored at -80 dB (top_db)
+
+   The filters are built once (mel_init) and stored as sparse rows: each
+   filter only keeps its first bin and its nonzero weights. mel_frame
+   turns a frame of 12-bit ADC samples into one column of 10 log10(mel
+   power), mel_tensor_f / mel_tensor_q8 write the last columns into a
+   float or int8 model input, mel major ((n_mels, frames) like librosa),
+   after the ref=max and top_db steps.
+
+   librosa centres its frames (n_fft / 2 samples of padding at both ends
+   of the file), the stream has no ends: only the first and last frames
+   of a training file differ from the stream.
+
+   Needs fft.h.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define MEL_AMIN 1e-10f   // power floor of power_to_db
+#define MEL_TOP_DB 80.0f  // dynamic range of power_to_db
+
+typedef struct
+{
+  unsigned int log2_N;  // FFT size
+  unsigned int nMels;
+  uint16_t *start;      // first FFT bin of each filter
+  uint16_t *count;      // number of bins of each filter
+  float **weights;      // weights of each filter
+  float *window;        // periodic Hann window, N values
+  float *frame;         // N floats: windowed samples, then FFT bins
+}
+mel_frontend;
+
+// Slaney mel scale (librosa htk=False): linear below 1 kHz, log above
+static double mel_from_hz(double f)
+{
+  const double fsp = 200.0 / 3, minLogHz = 1000.0, logStep = log(6.4) / 27.0;
+  if (f < minLogHz) return f / fsp;
+  return minLogHz / fsp + log(f / minLogHz) / logStep;
+}
+
+static double mel_to_hz(double m)
+{
+  const double fsp = 200.0 / 3, minLogHz = 1000.0, logStep = log(6.4) / 27.0;
+  const double minLogMel = minLogHz / fsp;
+  if (m < minLogMel) return m * fsp;
+  return minLogHz * exp(logStep * (m - minLogMel));
+}
+
+bool mel_init(mel_frontend *m, unsigned int sampleRate, unsigned int log2_N,
+              unsigned int nMels, float fmin, float fmax)
+{
+  unsigned int N = 1 << log2_N;
+  unsigned int nBins = N / 2 + 1;
+  if (!rfft_init(log2_N)) return false;
+  m->log2_N = log2_N;
+  m->nMels = nMels;
+  m->start = (uint16_t *) calloc(nMels, sizeof(uint16_t));
+  m->count = (uint16_t *) calloc(nMels, sizeof(uint16_t));
+  m->weights = (float **) calloc(nMels, sizeof(float *));
+  m->window = (float *) malloc(N * sizeof(float));
+  m->frame = (float *) malloc(N * sizeof(float));
+  double *hz = (double *) malloc((nMels + 2) * sizeof(double));
+  if (!m->start || !m->count || !m->weights || !m->window || !m->frame || !hz) return false;
+
+  for (unsigned int i = 0; i < N; i++) m->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / N);
+
+  // Band edges, equally spaced on the mel scale
+  double melMin = mel_from_hz(fmin), melMax = mel_from_hz(fmax);
+  for (unsigned int i = 0; i < nMels + 2; i++)
+    hz[i] = mel_to_hz(melMin + (melMax - melMin) * i / (nMels + 1));
+
+  for (unsigned int i = 0; i < nMels; i++) {
+    double norm = 2.0 / (hz[i + 2] - hz[i]);  // Slaney normalization
+    unsigned int first = nBins, last = 0;
+    for (unsigned int k = 0; k < nBins; k++) {
+      double f = (double) k * sampleRate / N;
+      double lower = (f - hz[i]) / (hz[i + 1] - hz[i]);
+      double upper = (hz[i + 2] - f) / (hz[i + 2] - hz[i + 1]);
+      if (lower > 0 && upper > 0) {
+        if (first == nBins) first = k;
+        last = k;
+      }
+    }
+    if (first == nBins) continue;  // band narrower than a bin: always 0
+    m->start[i] = first;
+    m->count[i] = last - first + 1;
+    m->weights[i] = (float *) malloc(m->count[i] * sizeof(float));
+    if (m->weights[i] == NULL) return false;
+    for (unsigned int k = first; k <= last; k++) {
+      double f = (double) k * sampleRate / N;
+      double lower = (f - hz[i]) / (hz[i + 1] - hz[i]);
+      double upper = (hz[i + 2] - f) / (hz[i + 2] - hz[i + 1]);
+      m->weights[i][k - first] = norm * ((lower < upper) ? lower : upper);
+    }
+  }
+  free(hz);
+  return true;
+}
+
+// One column of 10 log10(mel power) from N 12-bit ADC samples
+void mel_frame(mel_frontend *m, const uint16_t *samples, float *column)
+{
+  unsigned int N = 1 << m->log2_N;
+  const uint16_t *slot = rfft_slots(m->log2_N);
+  float *data = m->frame;
+  // Samples in [-1, 1] like librosa.load, without the ADC offset
+  long sum = 0;
+  for (unsigned int i = 0; i < N; i++) sum += samples[i];
+  float dc = (float) sum / N;
+  for (unsigned int i = 0; i < N; i++)
+    data[slot[i]] = (samples[i] - dc) * (m->window[i] / 2048.0f);
+  rfft_evaluate_f(data, m->log2_N);
+
+  // Power spectrum in place: bin k in data[k], k = 0 ... N / 2
+  float nyquist = data[1] * data[1];
+  data[0] *= data[0];
+  for (unsigned int k = 1; k < N / 2; k++)
+    data[k] = data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+  data[N / 2] = nyquist;
+
+  for (unsigned int i = 0; i < m->nMels; i++) {
+    const float *p = data + m->start[i];
+    const float *w = m->weights[i];
+    float e = 0;
+    for (unsigned int k = 0; k < m->count[i]; k++) e += w[k] * p[k];
+    column[i] = 10.0f * log10f((e > MEL_AMIN) ? e : MEL_AMIN);
+  }
+}
+
+// power_to_db(ref=np.max) of frames columns (time major, as returned by
+// stft_spectrogram) into a float input, mel major
+void mel_tensor_f(const float *columns, unsigned int frames, unsigned int nMels, float *dest)
+{
+  float top = -INFINITY;
+  for (unsigned int i = 0; i < frames * nMels; i++)
+    if (columns[i] > top) top = columns[i];
+  for (unsigned int t = 0; t < frames; t++)
+    for (unsigned int i = 0; i < nMels; i++) {
+      float v = columns[t * nMels + i] - top;
+      dest[i * frames + t] = (v > -MEL_TOP_DB) ? v : -MEL_TOP_DB;
+    }
+}
+
+// Same, quantized for an int8 input: q = v / scale + zero point
+void mel_tensor_q8(const float *columns, unsigned int frames, unsigned int nMels,
+                   int8_t *dest, float scale, int zeroPoint)
+{
+  float top = -INFINITY;
+  for (unsigned int i = 0; i < frames * nMels; i++)
+    if (columns[i] > top) top = columns[i];
+  for (unsigned int t = 0; t < frames; t++)
+    for (unsigned int i = 0; i < nMels; i++) {
+      float v = columns[t * nMels + i] - top;
+      if (v < -MEL_TOP_DB) v = -MEL_TOP_DB;
+      long q = lroundf(v / scale) + zeroPoint;
+      dest[i * frames + t] = (q > 127) ? 127 : (q < -128) ? -128 : q;
+    }
+}
@@ -8,6 +8,12 @@
 #include "tensorflow/lite/schema/schema_generated.h"
 #include "tensorflow/lite/version.h"
 #include "my_model_data.h" // Include the TensorFlow Lite model converted to a C array
+#include <complex.h>
+#include "fft.h"
+#include "ring.h"
+#include "capture.h"
+#include "stft.h"
+#include "mel.h"
 
 #define OLED_RESET -1
 #define SCREEN_WIDTH 128
@@ -18,6 +24,18 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 const int microphonePin = 35; // Analog input pin for the microphone
 const int threshold = 80; // Threshold for snore detection
 
+// Log-mel features, as in the training (librosa defaults)
+#define MEL_RATE 22050  // sample rate (Hz)
+#define MEL_LOG2N 11    // FFT of 2048 samples
+#define MEL_HOP 512     // samples between two frames
+#define MEL_BANDS 128   // mel filters
+#define MEL_FRAMES 44   // frames of the model input, if not read from the model
+
+mel_frontend mel;
+stft_state stft;        // sample history and last mel columns
+unsigned int melFrames = MEL_FRAMES;
+float *melColumns;      // melFrames columns, oldest first
+
 // Define the input and output tensors
 
 namespace {
@@ -65,7 +83,11 @@ void setup() {
 
   static tflite::MicroMutableOpResolver micro_mutable_op_resolver;
   //micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_DEPTHWISE_CONV_2D, tflite::ops::micro::Register_DEPTHWISE_CONV_2D());
+  micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_CONV_2D, tflite::ops::micro::Register_CONV_2D());
+  micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_MAX_POOL_2D, tflite::ops::micro::Register_MAX_POOL_2D());
+  micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_RESHAPE, tflite::ops::micro::Register_RESHAPE());
   micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_FULLY_CONNECTED, tflite::ops::micro::Register_FULLY_CONNECTED());
+  micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_LOGISTIC, tflite::ops::micro::Register_LOGISTIC());
   micro_mutable_op_resolver.AddBuiltin(tflite::BuiltinOperator_SOFTMAX, tflite::ops::micro::Register_SOFTMAX());
 
 
@@ -80,16 +102,35 @@ void setup() {
   // Get the input and output tensors
   inputTensor = interpreter->input(0);
   outputTensor = interpreter->output(0);
+  // Input shape (1, MEL_BANDS, frames, 1)
+  if (inputTensor->dims->size == 4) melFrames = inputTensor->dims->data[2];
+
+  // Mel frontend, fed by hops of samples captured in the background
+  melColumns = (float*) malloc(melFrames * MEL_BANDS * sizeof(float));
+  if (melColumns == NULL || !mel_init(&mel, MEL_RATE, MEL_LOG2N, MEL_BANDS, 0, MEL_RATE / 2)
+      || !stft_init(&stft, 1 << MEL_LOG2N, MEL_HOP, MEL_BANDS, melFrames)
+      || !capture_begin(MEL_RATE, MEL_HOP)) {
+    Serial.println("Failed to start the mel frontend");
+    while (1);
+  }
 }
 
 void loop() {
-  int micValue = analogRead(microphonePin);
-
-  // Normalize the microphone value to be between 0 and 1
-  float micValueNormalized = micValue / 1024.0;
-
-  // Copy the microphone value to the input tensor
-  inputTensor->data.f[0] = micValueNormalized;
+  // Next hop of samples, appended to the history
+  const uint16_t *hop = capture_wait();
+  // Hops dropped by the capture (too slow): no frame across the gap
+  if (!capture_contiguous(hop)) stft_reset(&stft);
+  const uint16_t *frame = stft_push(&stft, hop);
+  capture_release();
+  if (frame == NULL) return;
+
+  // New log-mel column, then the last melFrames columns into the input tensor
+  mel_frame(&mel, frame, stft_next_column(&stft));
+  if (stft_spectrogram(&stft, melColumns, melFrames) < melFrames) return;
+  if (inputTensor->type == kTfLiteInt8)
+    mel_tensor_q8(melColumns, melFrames, MEL_BANDS, inputTensor->data.int8,
+                  inputTensor->params.scale, inputTensor->params.zero_point);
+  else mel_tensor_f(melColumns, melFrames, MEL_BANDS, inputTensor->data.f);
 
   // Run the inference
   TfLiteStatus status = interpreter->Invoke();
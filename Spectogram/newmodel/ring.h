@@ -0,0 +1,92 @@
+/*
+   Lock-free single-producer / single-consumer ring of frames
+
+   The ring holds a power of 2 number of fixed-size frames. Frames are
+   never copied: the producer leases the next free slot, fills it in
+   place and commits it; the consumer leases the oldest committed slot,
+   reads it in place and releases it. One producer and one consumer may
+   run on different cores, tasks or interrupts without any lock:
+   head is only written by the producer, tail only by the consumer.
+
+   When the ring is full, the producer gets no slot (ring_write_lease
+   returns NULL): the frame is lost and counted as an overrun.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+typedef struct
+{
+  uint8_t* data;                // slots * frameBytes
+  unsigned int frameBytes;
+  unsigned int mask;            // slots - 1
+  std::atomic<unsigned int> head;       // frames committed (producer)
+  std::atomic<unsigned int> tail;       // frames released (consumer)
+  std::atomic<unsigned long> overruns;  // frames lost, ring full
+}
+frame_ring;
+
+// Allocates a ring of slots (power of 2) frames of frameBytes bytes
+bool ring_init(frame_ring* r, unsigned int slots, unsigned int frameBytes)
+{
+  if (slots == 0 || (slots & (slots - 1)) != 0) return false;
+  r->data = (uint8_t*) calloc(slots, frameBytes);
+  if (r->data == NULL) return false;
+  r->frameBytes = frameBytes;
+  r->mask = slots - 1;
+  r->head.store(0);
+  r->tail.store(0);
+  r->overruns.store(0);
+  return true;
+}
+
+void ring_free(frame_ring* r)
+{
+  free(r->data);
+  r->data = NULL;
+}
+
+// Producer: next free slot, or NULL if the ring is full
+void* ring_write_lease(frame_ring* r)
+{
+  unsigned int head = r->head.load(std::memory_order_relaxed);
+  if (head - r->tail.load(std::memory_order_acquire) > r->mask) return NULL;
+  return r->data + (head & r->mask) * r->frameBytes;
+}
+
+// Producer: publishes the slot filled after ring_write_lease
+void ring_write_commit(frame_ring* r)
+{
+  r->head.store(r->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Producer: counts a frame lost because the ring was full
+void ring_overrun(frame_ring* r)
+{
+  r->overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Consumer: oldest committed frame, or NULL if the ring is empty
+const void* ring_read_lease(frame_ring* r)
+{
+  unsigned int tail = r->tail.load(std::memory_order_relaxed);
+  if (r->head.load(std::memory_order_acquire) == tail) return NULL;
+  return r->data + (tail & r->mask) * r->frameBytes;
+}
+
+// Consumer: gives the slot of ring_read_lease back to the producer
+void ring_read_release(frame_ring* r)
+{
+  r->tail.store(r->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Frames waiting for the consumer
+unsigned int ring_depth(frame_ring* r)
+{
+  return r->head.load(std::memory_order_acquire) - r->tail.load(std::memory_order_acquire);
+}
+
+unsigned long ring_overruns(frame_ring* r)
+{
+  return r->overruns.load(std::memory_order_relaxed);
+}
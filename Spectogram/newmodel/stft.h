@@ -0,0 +1,100 @@
+/*
+   Streaming short-time Fourier transform
+
+   The capture delivers hops of `hop` samples. Each hop is appended to a
+   circular history of the last `size` samples, and as soon as the
+   history is full every hop gives a new analysis frame: consecutive
+   frames overlap by size - hop samples (hop = size / 2: 50%, size / 4:
+   75%, size: no overlap). The samples are not captured again, they are
+   only written once in the history.
+
+   The history is stored twice (at i and i + size), so the last frame is
+   always a contiguous array of `size` samples, oldest first, read in
+   place by the FFT (stft_push).
+
+   The spectra of the frames are kept in a circular spectrogram of
+   `columns` columns of `bins` values (stft_next_column), read oldest
+   first by stft_spectrogram, for instance into the input tensor of a
+   CNN. The spectrogram must be read by the task which writes it.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  uint16_t *hist;         // 2 * size samples
+  unsigned int size;      // frame length
+  unsigned int hop;       // new samples per frame
+  unsigned int pos;       // oldest sample of the history
+  unsigned int filled;    // samples in the history, up to size
+  float *spec;            // columns * bins
+  unsigned int bins;      // values per column
+  unsigned int columns;   // columns in the spectrogram
+  unsigned int next;      // next column to write
+  unsigned long count;    // columns written
+}
+stft_state;
+
+bool stft_init(stft_state *s, unsigned int size, unsigned int hop,
+               unsigned int bins, unsigned int columns)
+{
+  if (hop == 0 || hop > size || size % hop != 0) return false;
+  s->hist = (uint16_t *) calloc(2 * size, sizeof(uint16_t));
+  s->spec = (float *) calloc(columns * bins, sizeof(float));
+  if (s->hist == NULL || s->spec == NULL) return false;
+  s->size = size;
+  s->hop = hop;
+  s->pos = 0;
+  s->filled = 0;
+  s->bins = bins;
+  s->columns = columns;
+  s->next = 0;
+  s->count = 0;
+  return true;
+}
+
+// Empties the history: the next frame comes after size new samples,
+// none of the samples before the reset is analysed again
+void stft_reset(stft_state *s)
+{
+  memset(s->hist, 0, 2 * s->size * sizeof(uint16_t));
+  s->pos = 0;
+  s->filled = 0;
+}
+
+// Appends a hop of samples. Returns the last frame (size samples,
+// oldest first), or NULL while the history is not full.
+const uint16_t* stft_push(stft_state *s, const uint16_t *samples)
+{
+  for (unsigned int i = 0; i < s->hop; i++) {
+    s->hist[s->pos] = s->hist[s->pos + s->size] = samples[i];
+    if (++s->pos == s->size) s->pos = 0;
+  }
+  if (s->filled < s->size) s->filled += s->hop;
+  if (s->filled < s->size) return NULL;
+  return s->hist + s->pos;
+}
+
+// Column of the spectrogram for the spectrum of the last frame
+float* stft_next_column(stft_state *s)
+{
+  float *column = s->spec + s->next * s->bins;
+  if (++s->next == s->columns) s->next = 0;
+  ++s->count;
+  return column;
+}
+
+// Copies the last n columns, oldest first (n x bins values, time major).
+// Returns the number of columns copied (less than n at the beginning).
+unsigned int stft_spectrogram(const stft_state *s, float *dest, unsigned int n)
+{
+  if (n > s->columns) n = s->columns;
+  if (n > s->count) n = s->count;
+  unsigned int c = (s->next + s->columns - n) % s->columns;
+  for (unsigned int i = 0; i < n; i++) {
+    memcpy(dest + i * s->bins, s->spec + c * s->bins, s->bins * sizeof(float));
+    if (++c == s->columns) c = 0;
+  }
+  return n;
+}
@@ -0,0 +1,159 @@
+/*
+   Golden test of the log-mel frontend of newmodel (mel.h)
+
+   Runs mel_frame on frames of a recording and compares its columns with
+   reference frames stored in mel_golden.txt, computed by mel_golden.py
+   from the definitions of librosa (Slaney mel filters, periodic Hann
+   window, power spectrum, 10 log10) in double precision with an exact
+   DFT. Both read the same samples: the first channel of the WAV at
+   22050 Hz, as 12-bit ADC values.
+
+   Compares
+     - the columns, in dB, on the bands within MEL_TOP_DB of the loudest
+       band of the frames (the range the model sees after power_to_db)
+     - the model input of mel_tensor_f on these columns with power_to_db
+       (ref=np.max, top_db 80) of the reference
+   and fails above MAX_DB_ERROR. mel_frame removes the mean of the frame
+   (the ADC offset), librosa does not: the first band, which holds the
+   bins 0 and 1, differs by the dc of the recording, and has its own
+   bound MAX_DC_ERROR.
+
+   Build and run:
+     g++ -O2 -std=gnu++17 mel_check.cpp -o mel_check
+     ./mel_check [mel_golden.txt] [file.wav]
+   The reference is rebuilt with python3 mel_golden.py > mel_golden.txt.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#define complex _Complex
+#include "../newmodel/fft.h"
+#include "../newmodel/mel.h"
+
+#define MEL_RATE 22050  // as in newmodel.ino
+#define MEL_LOG2N 11
+#define MEL_BANDS 128
+
+#define MAX_DB_ERROR 0.01  // float against double
+#define MAX_DC_ERROR 0.5   // first band: mean of the frame removed
+
+// Little-endian fields of the WAV header
+static uint32_t le32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24; }
+static uint16_t le16(const uint8_t* p) { return p[0] | p[1] << 8; }
+
+// First channel of a 16-bit PCM WAV file at a multiple of MEL_RATE, as
+// the 12-bit ADC samples of the sketch at MEL_RATE
+static std::vector<uint16_t> readWav(const char* path)
+{
+  std::vector<uint16_t> adc;
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) return adc;
+  uint8_t h[12], chunk[8], fmt[16] = {0};
+  if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) {
+    fclose(f);
+    return adc;
+  }
+  while (fread(chunk, 1, 8, f) == 8) {
+    const uint32_t size = le32(chunk + 4);
+    if (!memcmp(chunk, "fmt ", 4)) {
+      if (size < 16 || fread(fmt, 1, 16, f) != 16) break;
+      fseek(f, size - 16 + (size & 1), SEEK_CUR);
+    } else if (!memcmp(chunk, "data", 4)) {
+      const int channels = le16(fmt + 2), rate = le32(fmt + 4), bits = le16(fmt + 14);
+      if (le16(fmt) != 1 || bits != 16 || channels < 1 || rate % MEL_RATE) break;
+      const int step = channels * (rate / MEL_RATE);
+      std::vector<int16_t> s(size / 2);
+      s.resize(fread(s.data(), 2, s.size(), f));
+      for (size_t n = 0; n < s.size(); n += step) adc.push_back((s[n] >> 4) + 2048);
+      break;
+    } else fseek(f, size + (size & 1), SEEK_CUR);
+  }
+  fclose(f);
+  return adc;
+}
+
+int main(int argc, char** argv)
+{
+  const char* goldenFile = (argc > 1) ? argv[1] : "mel_golden.txt";
+  const char* wavFile = (argc > 2) ? argv[2] : "../0_0.wav";
+  const unsigned int N = 1 << MEL_LOG2N;
+
+  // Reference frames: first sample, then MEL_BANDS values
+  std::vector<long> starts;
+  std::vector<float> golden;
+  FILE* f = fopen(goldenFile, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s - cannot open\n", goldenFile);
+    return 1;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#') continue;
+    char* p = line;
+    starts.push_back(strtol(p, &p, 10));
+    for (int i = 0; i < MEL_BANDS; i++) golden.push_back(strtof(p, &p));
+  }
+  fclose(f);
+
+  const std::vector<uint16_t> adc = readWav(wavFile);
+  mel_frontend mel;
+  if (!mel_init(&mel, MEL_RATE, MEL_LOG2N, MEL_BANDS, 0, MEL_RATE / 2)) {
+    fprintf(stderr, "not enough memory\n");
+    return 1;
+  }
+  const size_t frames = starts.size();
+  std::vector<float> columns(frames * MEL_BANDS);
+  for (size_t t = 0; t < frames; t++) {
+    if (starts[t] < 0 || (size_t) starts[t] + N > adc.size()) {
+      fprintf(stderr, "%s - no samples %ld ... %ld at %d Hz\n", wavFile, starts[t], starts[t] + N - 1, MEL_RATE);
+      return 1;
+    }
+    mel_frame(&mel, &adc[starts[t]], &columns[t * MEL_BANDS]);
+  }
+
+  // Columns, on the bands the model sees
+  float top = -INFINITY;
+  for (float v : golden) top = fmaxf(top, v);
+  printf("%s: %zu frames of %d mels, %s\n\n", goldenFile, frames, MEL_BANDS, wavFile);
+  printf("%6s %8s %14s %8s %14s\n", "frame", "sample", "max error dB", "band", "first band dB");
+  double columnError = 0, dcError = 0;
+  for (size_t t = 0; t < frames; t++) {
+    double worst = 0;
+    int band = 1;
+    for (int i = 1; i < MEL_BANDS; i++) {
+      const float ref = golden[t * MEL_BANDS + i];
+      if (ref < top - MEL_TOP_DB) continue;
+      const double e = fabs(columns[t * MEL_BANDS + i] - ref);
+      if (e > worst) {
+        worst = e;
+        band = i;
+      }
+    }
+    const double dc = (golden[t * MEL_BANDS] < top - MEL_TOP_DB) ? 0
+                      : fabs(columns[t * MEL_BANDS] - golden[t * MEL_BANDS]);
+    printf("%6zu %8ld %14.4f %8d %14.4f\n", t, starts[t], worst, band, dc);
+    columnError = fmax(columnError, worst);
+    dcError = fmax(dcError, dc);
+  }
+
+  // Model input: power_to_db(ref=np.max, top_db=80), mel major
+  std::vector<float> input(frames * MEL_BANDS);
+  mel_tensor_f(columns.data(), frames, MEL_BANDS, input.data());
+  double inputError = 0;
+  for (size_t t = 0; t < frames; t++)
+    for (int i = 1; i < MEL_BANDS; i++) {
+      const float ref = fmaxf(golden[t * MEL_BANDS + i] - top, -MEL_TOP_DB);
+      inputError = fmax(inputError, fabs(input[i * frames + t] - ref));
+    }
+
+  const bool ok = frames > 0 && columnError <= MAX_DB_ERROR && inputError <= MAX_DB_ERROR
+                  && dcError <= MAX_DC_ERROR;
+  printf("\ncolumns: max error %.4f dB, model input: max error %.4f dB (bound %g)\n"
+         "first band: max error %.4f dB (bound %g)\n%s\n",
+         columnError, inputError, MAX_DB_ERROR, dcError, MAX_DC_ERROR, ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+# Reference log-mel frames of the frontend of newmodel (mel.h)
+#
+# Written out from the definitions of librosa (filters.mel with htk=False
+# and norm='slaney', feature.melspectrogram with n_fft 2048, hop 512,
+# window 'hann', power 2, power_to_db with amin 1e-10) in plain Python,
+# double precision and an exact DFT, so that it runs without numpy or
+# librosa and shares no code with mel.h. The samples are those the sketch
+# would capture: first channel of the WAV at 22050 Hz (0_0.wav is 44.1
+# kHz: every other sample), as 12-bit ADC values (s >> 4) + 2048, scaled
+# to [-1, 1] like librosa.load: (adc - 2048) / 2048.
+#
+# Writes one line per frame: its first sample, then the 128 values of
+# 10 log10(mel power). mel_check.cpp compares mel_frame with them.
+#
+#   python3 mel_golden.py [file.wav] > mel_golden.txt
+
+import math
+import struct
+import sys
+import wave
+
+SR = 22050
+N_FFT = 2048
+N_MELS = 128
+FRAMES = 8
+STEP = 2560  # samples between the reference frames (5 hops)
+
+
+def read_adc(path):
+    w = wave.open(path, 'rb')
+    channels, width, rate, n = w.getnchannels(), w.getsampwidth(), w.getframerate(), w.getnframes()
+    assert width == 2 and rate % SR == 0, 'needs 16-bit PCM at a multiple of 22050 Hz'
+    raw = struct.unpack('<%dh' % (n * channels), w.readframes(n))
+    return [(s >> 4) + 2048 for s in raw[0::channels * (rate // SR)]]
+
+
+def hz_to_mel(f):
+    f_sp, min_log_hz, logstep = 200.0 / 3, 1000.0, math.log(6.4) / 27.0
+    if f < min_log_hz:
+        return f / f_sp
+    return min_log_hz / f_sp + math.log(f / min_log_hz) / logstep
+
+
+def mel_to_hz(m):
+    f_sp, min_log_hz, logstep = 200.0 / 3, 1000.0, math.log(6.4) / 27.0
+    min_log_mel = min_log_hz / f_sp
+    if m < min_log_mel:
+        return f_sp * m
+    return min_log_hz * math.exp(logstep * (m - min_log_mel))
+
+
+def mel_filters():
+    fftfreqs = [k * (SR / 2) / (N_FFT // 2) for k in range(N_FFT // 2 + 1)]
+    lo, hi = hz_to_mel(0.0), hz_to_mel(SR / 2)
+    mel_f = [mel_to_hz(lo + (hi - lo) * i / (N_MELS + 1)) for i in range(N_MELS + 2)]
+    fdiff = [mel_f[i + 1] - mel_f[i] for i in range(N_MELS + 1)]
+    weights = []
+    for i in range(N_MELS):
+        enorm = 2.0 / (mel_f[i + 2] - mel_f[i])
+        row = []
+        for f in fftfreqs:
+            lower = (f - mel_f[i]) / fdiff[i]
+            upper = (mel_f[i + 2] - f) / fdiff[i + 1]
+            row.append(enorm * max(0.0, min(lower, upper)))
+        weights.append(row)
+    return weights
+
+
+def power_spectrum(y):
+    window = [0.5 - 0.5 * math.cos(2 * math.pi * n / N_FFT) for n in range(N_FFT)]
+    x = [y[n] * window[n] for n in range(N_FFT)]
+    cos_t = [math.cos(2 * math.pi * n / N_FFT) for n in range(N_FFT)]
+    sin_t = [math.sin(2 * math.pi * n / N_FFT) for n in range(N_FFT)]
+    power = []
+    for k in range(N_FFT // 2 + 1):
+        re = im = 0.0
+        j = 0
+        for v in x:
+            re += v * cos_t[j]
+            im -= v * sin_t[j]
+            j = (j + k) % N_FFT
+        power.append(re * re + im * im)
+    return power
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else '../0_0.wav'
+    adc = read_adc(path)
+    weights = mel_filters()
+    print('# %s: %d frames of 10 log10(mel power), first sample then %d mels' % (path, FRAMES, N_MELS))
+    for f in range(FRAMES):
+        start = f * STEP
+        y = [(a - 2048) / 2048.0 for a in adc[start:start + N_FFT]]
+        power = power_spectrum(y)
+        column = []
+        for row in weights:
+            e = sum(w * p for w, p in zip(row, power) if w > 0)
+            column.append(10 * math.log10(max(e, 1e-10)))
+        print(start, ' '.join('%.4f' % v for v in column))
+
+
+main()